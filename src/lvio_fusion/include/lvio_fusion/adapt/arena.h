@@ -0,0 +1,119 @@
+#ifndef lvio_fusion_ARENA_H
+#define lvio_fusion_ARENA_H
+
+#include "lvio_fusion/common.h"
+
+#include <type_traits>
+
+namespace lvio_fusion
+{
+
+namespace adapt
+{
+
+// monotonic memory for objects that live as long as a problem, released all at once
+class Arena
+{
+public:
+    /**
+     * @param block_size    bytes of every block, bigger objects get their own block
+     */
+    Arena(size_t block_size = 1 << 20) : block_size_(block_size) {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        Release();
+    }
+
+    // thread safe
+    template <typename T, typename... Args>
+    T *New(Args &&... args)
+    {
+        // at least 16 bytes aligned for fixed-size eigen members
+        void *memory = Allocate(sizeof(T), std::max<size_t>(alignof(T), 16));
+        T *object = ::new (memory) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            destructors_.push_back(std::make_pair((void *)object, &Destroy<T>));
+        }
+        return object;
+    }
+
+    bool Owns(const void *object)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto &block : blocks_)
+        {
+            if (object >= block.first && object < block.first + block.second)
+                return true;
+        }
+        return false;
+    }
+
+    // destroy the objects in reverse order and free the memory
+    void Release()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto iter = destructors_.rbegin(); iter != destructors_.rend(); iter++)
+        {
+            iter->second(iter->first);
+        }
+        destructors_.clear();
+        for (auto &block : blocks_)
+        {
+            ::operator delete(block.first);
+        }
+        blocks_.clear();
+        current_ = nullptr;
+        used_ = 0;
+    }
+
+private:
+    template <typename T>
+    static void Destroy(void *object)
+    {
+        static_cast<T *>(object)->~T();
+    }
+
+    void *Allocate(size_t size, size_t align)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (size + align > block_size_)
+        {
+            // keep the current block for the small objects
+            char *memory = static_cast<char *>(::operator new(size + align));
+            blocks_.push_back(std::make_pair(memory, size + align));
+            return Align(memory, align);
+        }
+        if (!current_ || Align(current_ + used_, align) + size > current_ + block_size_)
+        {
+            current_ = static_cast<char *>(::operator new(block_size_));
+            blocks_.push_back(std::make_pair(current_, block_size_));
+            used_ = 0;
+        }
+        char *memory = Align(current_ + used_, align);
+        used_ = memory + size - current_;
+        return memory;
+    }
+
+    static char *Align(char *p, size_t align)
+    {
+        return reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    std::mutex mutex_;
+    std::vector<std::pair<char *, size_t>> blocks_; // begin, size
+    char *current_ = nullptr;                       // block of the small objects
+    size_t used_ = 0;                               // bytes used in the current block
+    std::vector<std::pair<void *, void (*)(void *)>> destructors_;
+    const size_t block_size_;
+};
+
+} // namespace adapt
+} // namespace lvio_fusion
+
+#endif // lvio_fusion_ARENA_H
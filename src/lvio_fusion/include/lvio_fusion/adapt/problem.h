@@ -1,9 +1,12 @@
 #ifndef lvio_fusion_PROBLEM_H
 #define lvio_fusion_PROBLEM_H
 
+#include "lvio_fusion/adapt/arena.h"
 #include "lvio_fusion/common.h"
 
+#include <array>
 #include <ceres/ceres.h>
+#include <unordered_set>
 
 namespace lvio_fusion
 {
@@ -31,9 +34,27 @@ const std::map<ProblemType, int> init_num_types = {
 namespace adapt
 {
 
-class Problem : public ceres::Problem
+// cost functions, loss functions and parameterizations are owned by the problem:
+// the ones made by New() are released with the arena, others are deleted one by one.
+// the arena is a base so that it is released after ceres::Problem
+class Problem : private Arena, public ceres::Problem
 {
 public:
+    Problem() : ceres::Problem(ProblemOptions()) {}
+
+    ~Problem()
+    {
+        for (auto cost_function : cost_functions_)
+            delete cost_function;
+        for (auto loss_function : loss_functions_)
+            delete loss_function;
+        for (auto local_parameterization : local_parameterizations_)
+            delete local_parameterization;
+    }
+
+    // allocate in the arena of the problem, thread safe
+    using Arena::New;
+
     template <typename... Ts>
     void AddResidualBlock(
         ProblemType type,
@@ -41,9 +62,38 @@ public:
         ceres::LossFunction *loss_function,
         double *x0, Ts *...xs)
     {
-        ceres::ResidualBlockId id = ceres::Problem::AddResidualBlock(cost_function, loss_function, x0, xs...);
-        types[id] = type;
+        ceres::Problem::AddResidualBlock(cost_function, loss_function, x0, xs...);
+        Adopt(cost_function, cost_functions_);
+        Adopt(loss_function, loss_functions_);
         num_types[type]++;
+        // count the types of residuals on every parameter block
+        double *paras[] = {x0, xs...};
+        for (double *para : paras)
+        {
+            para_types_[para][(int)type]++;
+        }
+    }
+
+    // one residual block of several observations, the shared parameter blocks are followed by one block per observation
+    void AddResidualBlock(
+        const std::vector<ProblemType> &types,
+        ceres::CostFunction *cost_function,
+        ceres::LossFunction *loss_function,
+        const std::vector<double *> &paras)
+    {
+        ceres::Problem::AddResidualBlock(cost_function, loss_function, paras);
+        Adopt(cost_function, cost_functions_);
+        Adopt(loss_function, loss_functions_);
+        int num_shared = paras.size() - types.size();
+        for (int i = 0; i < types.size(); i++)
+        {
+            num_types[types[i]]++;
+            for (int j = 0; j < num_shared; j++)
+            {
+                para_types_[paras[j]][(int)types[i]]++;
+            }
+            para_types_[paras[num_shared + i]][(int)types[i]]++;
+        }
     }
 
     void AddParameterBlock(double *values, int size)
@@ -60,24 +110,49 @@ public:
             num_frames++;
         }
         ceres::Problem::AddParameterBlock(values, size, local_parameterization);
+        Adopt(local_parameterization, local_parameterizations_);
     }
 
     std::map<ProblemType, int> GetTypes(double *para)
     {
-        std::vector<ceres::ResidualBlockId> residual_blocks;
-        GetResidualBlocksForParameterBlock(para, &residual_blocks);
-
         std::map<ProblemType, int> result = init_num_types;
-        for (auto i : residual_blocks)
+        auto iter = para_types_.find(para);
+        if (iter != para_types_.end())
         {
-            result[types[i]]++;
+            for (auto &pair : result)
+            {
+                pair.second = iter->second[(int)pair.first];
+            }
         }
         return result;
     }
 
     int num_frames = 0;
-    std::unordered_map<ceres::ResidualBlockId, ProblemType> types;
     std::map<ProblemType, int> num_types = init_num_types;
+
+private:
+    static ceres::Problem::Options ProblemOptions()
+    {
+        ceres::Problem::Options options;
+        options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+        options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+        options.local_parameterization_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+        return options;
+    }
+
+    template <typename T>
+    void Adopt(T *object, std::unordered_set<T *> &owned)
+    {
+        if (object && !Owns(object))
+        {
+            owned.insert(object);
+        }
+    }
+
+    std::unordered_map<double *, std::array<int, (int)ProblemType::Other + 1>> para_types_;
+    std::unordered_set<ceres::CostFunction *> cost_functions_;
+    std::unordered_set<ceres::LossFunction *> loss_functions_;
+    std::unordered_set<ceres::LocalParameterization *> local_parameterizations_;
 };
 
 inline void Solve(const ceres::Solver::Options &options,
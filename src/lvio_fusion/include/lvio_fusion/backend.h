@@ -2,6 +2,7 @@
 #define lvio_fusion_BACKEND_H
 
 #include "lvio_fusion/adapt/problem.h"
+#include "lvio_fusion/ceres/prior_error.hpp"
 #include "lvio_fusion/common.h"
 #include "lvio_fusion/frame.h"
 #include "lvio_fusion/imu/initializer.h"
@@ -17,7 +18,34 @@ class Backend
 public:
     typedef std::shared_ptr<Backend> Ptr;
 
-    Backend(double window_size, bool update_weights);
+    // statistics of the last solve
+    struct Statistics
+    {
+        int num_iterations = 0;
+        int num_residual_blocks = 0;
+        double linear_solver_time = 0;      // seconds
+        double residual_evaluation_time = 0;
+        double jacobian_evaluation_time = 0;
+        double total_time = 0;
+        int num_kfs = 0;                    // keyframes kept in the window
+        int num_landmarks = 0;              // landmarks in the map
+        size_t landmark_memory = 0;         // bytes
+    };
+
+    /**
+     * @param window_size       max time span of the window (seconds)
+     * @param update_weights    update weights of the residuals
+     * @param marginalization   keep information of keyframes leaving the window
+     * @param multi_observation one residual block for all observations of a landmark
+     * @param min_kfs           min number of keyframes kept in the window
+     * @param max_kfs           max number of keyframes kept in the window
+     * @param min_covisibility  older keyframes sharing fewer landmarks leave the window, 0 for disabled
+     * @param time_budget       expected time of one optimization (seconds), 0 for no budget
+     * @param culling           remove redundant keyframes leaving the window
+     * @param min_observations  landmarks with fewer observations are removed after leaving the window
+     */
+    Backend(double window_size, bool update_weights, bool marginalization, bool multi_observation,
+            int min_kfs, int max_kfs, int min_covisibility, double time_budget, bool culling, int min_observations);
 
     void SetFrontend(std::shared_ptr<Frontend> frontend) { frontend_ = frontend; }
 
@@ -27,8 +55,11 @@ public:
 
     void UpdateMap();
 
+    Statistics GetStatistics();
+
     std::mutex mutex;
     double finished = 0;
+    double active_end = 0; // the newest keyframe of the last solved window
 
 private:
     void BackendLoop();
@@ -37,10 +68,29 @@ private:
 
     void Optimize();
 
+    // resize the window from the measured time of optimization
+    void AdaptWindow(double time_used);
+
+    // start of the next window, keeps at most num_kfs_ keyframes and window_size_ seconds,
+    // and stops at the first keyframe weakly covisible with the newer ones if min_covisibility_ > 0
+    double WindowStart(Frames &active_kfs);
+
     void UpdateFrontend(SE3d transform, double time);
 
     double BuildProblem(Frames &active_kfs, adapt::Problem &problem);
 
+    void SetOrdering(adapt::Problem &problem, ceres::Solver::Options &options);
+
+    void Marginalize(Frames &active_kfs, double time);
+
+    // remove keyframes before time whose landmarks are mostly observed by other keyframes
+    void CullKeyFrames(Frames &active_kfs, double time);
+
+    bool IsRedundant(Frame::Ptr frame, Frame::Ptr next_frame);
+
+    // remove weak landmarks whose observations are all before time
+    void PruneLandmarks(Frames &active_kfs, double time);
+
     std::weak_ptr<Frontend> frontend_;
     Mapping::Ptr mapping_;
     Initializer::Ptr initializer_;
@@ -51,6 +101,21 @@ private:
     double global_end_ = 0;
     const double window_size_;
     const bool update_weights_;
+    const bool marginalization_;
+    const bool multi_observation_;
+    const int min_kfs_, max_kfs_;
+    const int min_covisibility_;
+    const double time_budget_;
+    int num_kfs_;
+    const bool culling_;
+    const double max_culled_interval_ = 3; // max time between the keyframes around a culled one
+    const int min_observations_;
+    double time_used_ = 0;  // moving average of time of optimization
+    Prior::Ptr prior_;
+    std::pair<int, bool> last_structure_;   // number of keyframes, imu is initialized
+    double last_radius_ = 0;                // trust region radius at the end of the last solve
+    std::mutex mutex_statistics_;
+    Statistics statistics_;
 };
 
 } // namespace lvio_fusion
@@ -0,0 +1,95 @@
+#ifndef lvio_fusion_PRIOR_ERROR_H
+#define lvio_fusion_PRIOR_ERROR_H
+
+#include "lvio_fusion/ceres/base.hpp"
+#include "lvio_fusion/common.h"
+#include "lvio_fusion/utility.h"
+
+namespace lvio_fusion
+{
+
+// linearized information of the marginalized keyframes, left on the first keyframe of the window
+struct Prior
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    typedef std::shared_ptr<Prior> Ptr;
+
+    // dimension of tangent space, 6 for pose only, 15 for pose, velocity and bias
+    int Size() const { return r.size(); }
+
+    double time = 0; // time of the keyframe
+    SE3d pose;       // linearization point
+    SE3d last_pose;  // pose after the last solve, to follow updates from other threads
+    Vector3d v = Vector3d::Zero(), ba = Vector3d::Zero(), bg = Vector3d::Zero();
+    MatrixXd J; // sqrt of information
+    VectorXd r; // linearized residual
+};
+
+class PriorError : public ceres::CostFunction
+{
+public:
+    PriorError(Prior::Ptr prior) : prior_(prior)
+    {
+        set_num_residuals(prior->Size());
+        mutable_parameter_block_sizes()->push_back(SE3d::num_parameters);
+        if (prior->Size() == 15)
+        {
+            mutable_parameter_block_sizes()->push_back(3);
+            mutable_parameter_block_sizes()->push_back(3);
+            mutable_parameter_block_sizes()->push_back(3);
+        }
+    }
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+    {
+        const int n = prior_->Size();
+        Quaterniond q(parameters[0][3], parameters[0][0], parameters[0][1], parameters[0][2]);
+        Vector3d t(parameters[0][4], parameters[0][5], parameters[0][6]);
+        // same tangent space as EigenQuaternionParameterization: q = [sin(dx), cos(dx)] * q0
+        Quaterniond q0_inv = prior_->pose.unit_quaternion().inverse();
+        Quaterniond dq = q * q0_inv;
+        double sign = dq.w() < 0 ? -1 : 1;
+        VectorXd dx(n);
+        dx.head<3>() = sign * dq.vec();
+        dx.segment<3>(3) = t - prior_->pose.translation();
+        if (n == 15)
+        {
+            dx.segment<3>(6) = Eigen::Map<const Vector3d>(parameters[1]) - prior_->v;
+            dx.segment<3>(9) = Eigen::Map<const Vector3d>(parameters[2]) - prior_->ba;
+            dx.segment<3>(12) = Eigen::Map<const Vector3d>(parameters[3]) - prior_->bg;
+        }
+        Eigen::Map<VectorXd>(residuals, n) = prior_->r + prior_->J * dx;
+
+        if (jacobians)
+        {
+            if (jacobians[0])
+            {
+                Matrix<double, 6, 7> jacobian_dx = Matrix<double, 6, 7>::Zero();
+                jacobian_dx.block<3, 3>(0, 0) = sign * (q0_inv.w() * Matrix3d::Identity() - skew_symmetric(q0_inv.vec()));
+                jacobian_dx.block<3, 1>(0, 3) = sign * q0_inv.vec();
+                jacobian_dx.block<3, 3>(3, 4) = Matrix3d::Identity();
+                Eigen::Map<Matrix<double, Dynamic, 7, RowMajor>>(jacobians[0], n, 7) = prior_->J.leftCols<6>() * jacobian_dx;
+            }
+            for (int i = 1; i < 4 && n == 15; i++)
+            {
+                if (jacobians[i])
+                {
+                    Eigen::Map<Matrix<double, Dynamic, 3, RowMajor>>(jacobians[i], n, 3) = prior_->J.middleCols<3>(3 + 3 * i);
+                }
+            }
+        }
+        return true;
+    }
+
+    static ceres::CostFunction *Create(Prior::Ptr prior)
+    {
+        return new PriorError(prior);
+    }
+
+private:
+    Prior::Ptr prior_;
+};
+
+} // namespace lvio_fusion
+
+#endif // lvio_fusion_PRIOR_ERROR_H
@@ -2,54 +2,257 @@
 #define lvio_fusion_VISUAL_ERROR_H
 
 #include "lvio_fusion/ceres/base.hpp"
-#include "lvio_fusion/visual/camera.h"
+#include "lvio_fusion/utility.h"
+#include "lvio_fusion/visual/camera_model.h"
 
 namespace lvio_fusion
 {
 
-template <typename T>
-inline void Reprojection(const T *pw, const T *Twc, Camera::Ptr camera, T *result)
+// jacobian of pinhole projection w.r.t. the point in the sensor
+inline Matrix<double, 2, 3> projection_jacobian(const PinholeModel &camera, const Vector3d &pc)
 {
-    T e[7], e_i[7], Twc_i[7], pc[3], pc_[3];
-    ceres::SE3Inverse(Twc, Twc_i);
-    ceres::SE3TransformPoint(Twc_i, pw, pc_);
-    ceres::Cast(camera->extrinsic.data(), SE3d::num_parameters, e);
-    ceres::SE3Inverse(e, e_i);
-    ceres::SE3TransformPoint(e_i, pc_, pc);
-    T xp = pc[0] / pc[2];
-    T yp = pc[1] / pc[2];
-    result[0] = camera->fx * xp + camera->cx;
-    result[1] = camera->fy * yp + camera->cy;
+    double inv_z = 1 / pc.z(), inv_z2 = inv_z * inv_z;
+    Matrix<double, 2, 3> ans;
+    ans << camera.fx * inv_z, 0, -camera.fx * pc.x() * inv_z2,
+        0, camera.fy * inv_z, -camera.fy * pc.y() * inv_z2;
+    return ans;
 }
 
-template <typename T>
-inline void Pixel2Robot(const T *ob, const T *inv_d, Camera::Ptr camera, T *result)
+// analytic jacobians of PoseOnlyReprojectionError
+class PoseOnlyReprojectionCost : public ceres::SizedCostFunction<2, 7>
 {
-    T d = T(1) / inv_d[0];
-    T ps[3] = {T((ob[0] - camera->cx) / camera->fx) * d, T((ob[1] - camera->cy) / camera->fy) * d, d};
-    T e[7];
-    ceres::Cast(camera->extrinsic.data(), SE3d::num_parameters, e);
-    ceres::SE3TransformPoint(e, ps, result);
-}
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    PoseOnlyReprojectionCost(Vector2d ob, Vector3d pw, Camera::Ptr camera, double weight)
+        : ob_(ob), pw_(pw), camera_(*camera), Rcb_(camera_.Rcb()), weight_(weight) {}
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+    {
+        Quaterniond q(parameters[0][3], parameters[0][0], parameters[0][1], parameters[0][2]);
+        Vector3d t(parameters[0][4], parameters[0][5], parameters[0][6]);
+        Matrix3d Rbw = q.toRotationMatrix().transpose();
+        Vector3d d = pw_ - t;
+        Vector3d pb = Rbw * d, pc;
+        Vector2d pixel;
+        camera_.Robot2Sensor(pb.data(), pc.data());
+        camera_.Sensor2Pixel(pc.data(), pixel.data());
+        Eigen::Map<Vector2d> residual(residuals);
+        residual = weight_ * (pixel - ob_);
+
+        if (jacobians && jacobians[0])
+        {
+            Matrix<double, 2, 3> J_pb = weight_ * projection_jacobian(camera_, pc) * Rcb_ * Rbw;
+            Eigen::Map<Matrix<double, 2, 7, RowMajor>> jacobian_pose(jacobians[0]);
+            jacobian_pose << 2 * J_pb * skew_symmetric(d) * q_plus_jacobian(q).transpose(), -J_pb;
+        }
+        return true;
+    }
 
-template <typename T>
-inline void Robot2Pixel(const T *pb, Camera::Ptr camera, T *result)
+private:
+    Vector2d ob_;
+    Vector3d pw_;
+    PinholeModel camera_;
+    Matrix3d Rcb_;
+    double weight_;
+};
+
+// analytic jacobians of TwoFrameReprojectionError
+class TwoFrameReprojectionCost : public ceres::SizedCostFunction<2, 1, 7, 7>
 {
-    T e[7], e_i[7], pc[3];
-    ceres::Cast(camera->extrinsic.data(), SE3d::num_parameters, e);
-    ceres::SE3Inverse(e, e_i);
-    ceres::SE3TransformPoint(e_i, pb, pc);
-    T xp = pc[0] / pc[2];
-    T yp = pc[1] / pc[2];
-    result[0] = camera->fx * xp + camera->cx;
-    result[1] = camera->fy * yp + camera->cy;
-}
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    TwoFrameReprojectionCost(Vector2d first_ob, Vector2d ob, Camera::Ptr left, Camera::Ptr right, double weight)
+        : ob_(ob), left_(*left), Rcb_(left_.Rcb()), weight_(weight)
+    {
+        // the point in the robot is linear in depth: pb = pn_ * depth + tbc_
+        Vector3d pn, zero = Vector3d::Zero();
+        PinholeModel right_camera(*right);
+        right_camera.Pixel2Sensor(first_ob.data(), 1.0, pn.data());
+        right_camera.Sensor2Robot(zero.data(), tbc_.data());
+        pn_ = right_camera.Rbc() * pn;
+    }
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+    {
+        double inv_d = parameters[0][0];
+        Quaterniond q1(parameters[1][3], parameters[1][0], parameters[1][1], parameters[1][2]);
+        Vector3d t1(parameters[1][4], parameters[1][5], parameters[1][6]);
+        Quaterniond q2(parameters[2][3], parameters[2][0], parameters[2][1], parameters[2][2]);
+        Vector3d t2(parameters[2][4], parameters[2][5], parameters[2][6]);
+        Matrix3d R1 = q1.toRotationMatrix(), Rbw2 = q2.toRotationMatrix().transpose();
+        Vector3d pb1 = pn_ / inv_d + tbc_, pc2;
+        Vector3d R1_pb1 = R1 * pb1;
+        Vector3d d = R1_pb1 + t1 - t2;
+        Vector3d pb2 = Rbw2 * d;
+        Vector2d pixel;
+        left_.Robot2Sensor(pb2.data(), pc2.data());
+        left_.Sensor2Pixel(pc2.data(), pixel.data());
+        Eigen::Map<Vector2d> residual(residuals);
+        residual = weight_ * (pixel - ob_);
+
+        if (jacobians)
+        {
+            Matrix<double, 2, 3> J_pw = weight_ * projection_jacobian(left_, pc2) * Rcb_ * Rbw2;
+            if (jacobians[0])
+            {
+                Eigen::Map<Vector2d> jacobian_inv_d(jacobians[0]);
+                jacobian_inv_d = -J_pw * R1 * pn_ / (inv_d * inv_d);
+            }
+            if (jacobians[1])
+            {
+                Eigen::Map<Matrix<double, 2, 7, RowMajor>> jacobian_pose_1(jacobians[1]);
+                jacobian_pose_1 << -2 * J_pw * skew_symmetric(R1_pb1) * q_plus_jacobian(q1).transpose(), J_pw;
+            }
+            if (jacobians[2])
+            {
+                Eigen::Map<Matrix<double, 2, 7, RowMajor>> jacobian_pose_2(jacobians[2]);
+                jacobian_pose_2 << 2 * J_pw * skew_symmetric(d) * q_plus_jacobian(q2).transpose(), -J_pw;
+            }
+        }
+        return true;
+    }
+
+private:
+    Vector2d ob_;
+    Vector3d pn_, tbc_;
+    PinholeModel left_;
+    Matrix3d Rcb_;
+    double weight_;
+};
+
+// all observations of a landmark in one residual block, parameters: inv_d, Twc1, Twc of every observation,
+// the back-projection in the first frame is shared by all observations
+class MultiFrameReprojectionCost : public ceres::CostFunction
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    MultiFrameReprojectionCost(Vector2d first_ob, const Matrix2Xd &obs, const VectorXd &weights, Camera::Ptr left, Camera::Ptr right)
+        : obs_(obs), weights_(weights), left_(*left), Rcb_(left_.Rcb())
+    {
+        Vector3d pn, zero = Vector3d::Zero();
+        PinholeModel right_camera(*right);
+        right_camera.Pixel2Sensor(first_ob.data(), 1.0, pn.data());
+        right_camera.Sensor2Robot(zero.data(), tbc_.data());
+        pn_ = right_camera.Rbc() * pn;
+
+        set_num_residuals(2 * obs_.cols());
+        mutable_parameter_block_sizes()->push_back(1);
+        mutable_parameter_block_sizes()->push_back(7);
+        for (int i = 0; i < obs_.cols(); i++)
+        {
+            mutable_parameter_block_sizes()->push_back(7);
+        }
+    }
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+    {
+        int n = obs_.cols();
+        double inv_d = parameters[0][0];
+        Quaterniond q1(parameters[1][3], parameters[1][0], parameters[1][1], parameters[1][2]);
+        Vector3d t1(parameters[1][4], parameters[1][5], parameters[1][6]);
+        Matrix3d R1 = q1.toRotationMatrix();
+        Vector3d R1_pb1 = R1 * (pn_ / inv_d + tbc_);
+        Vector3d pw = R1_pb1 + t1;
+        Vector3d J_inv_d = -R1 * pn_ / (inv_d * inv_d);
+        Matrix<double, 3, 4> J_q1 = -2 * skew_symmetric(R1_pb1) * q_plus_jacobian(q1).transpose();
+
+        Eigen::Map<VectorXd> residual(residuals, 2 * n);
+        Eigen::Map<VectorXd> jacobian_inv_d(jacobians && jacobians[0] ? jacobians[0] : nullptr, jacobians && jacobians[0] ? 2 * n : 0);
+        Eigen::Map<Matrix<double, Dynamic, 7, RowMajor>> jacobian_pose_1(jacobians && jacobians[1] ? jacobians[1] : nullptr, jacobians && jacobians[1] ? 2 * n : 0, 7);
+        for (int i = 0; i < n; i++)
+        {
+            const double *para = parameters[i + 2];
+            Quaterniond q2(para[3], para[0], para[1], para[2]);
+            Vector3d t2(para[4], para[5], para[6]);
+            Matrix3d Rbw2 = q2.toRotationMatrix().transpose();
+            Vector3d d = pw - t2;
+            Vector3d pb2 = Rbw2 * d, pc2;
+            Vector2d pixel;
+            left_.Robot2Sensor(pb2.data(), pc2.data());
+            left_.Sensor2Pixel(pc2.data(), pixel.data());
+            residual.segment<2>(2 * i) = weights_[i] * (pixel - obs_.col(i));
+
+            if (jacobians)
+            {
+                Matrix<double, 2, 3> J_pw = weights_[i] * projection_jacobian(left_, pc2) * Rcb_ * Rbw2;
+                if (jacobians[0])
+                {
+                    jacobian_inv_d.segment<2>(2 * i) = J_pw * J_inv_d;
+                }
+                if (jacobians[1])
+                {
+                    jacobian_pose_1.middleRows<2>(2 * i) << J_pw * J_q1, J_pw;
+                }
+                if (jacobians[i + 2])
+                {
+                    // only the rows of its own observation depend on the pose
+                    Eigen::Map<Matrix<double, Dynamic, 7, RowMajor>> jacobian_pose_2(jacobians[i + 2], 2 * n, 7);
+                    jacobian_pose_2.setZero();
+                    jacobian_pose_2.middleRows<2>(2 * i) << 2 * J_pw * skew_symmetric(d) * q_plus_jacobian(q2).transpose(), -J_pw;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    Matrix2Xd obs_;
+    VectorXd weights_;
+    Vector3d pn_, tbc_;
+    PinholeModel left_;
+    Matrix3d Rcb_;
+};
+
+// analytic jacobians of TwoCameraReprojectionError
+class TwoCameraReprojectionCost : public ceres::SizedCostFunction<2, 1>
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    TwoCameraReprojectionCost(Vector2d left_ob, Vector2d right_ob, Camera::Ptr left, Camera::Ptr right, double weight)
+        : left_ob_(left_ob), left_(*left), weight_(weight)
+    {
+        // the point in the left camera is linear in depth: pc = a * depth + b
+        Vector3d pn, zero = Vector3d::Zero(), pb;
+        PinholeModel right_camera(*right);
+        right_camera.Pixel2Sensor(right_ob.data(), 1.0, pn.data());
+        right_camera.Sensor2Robot(zero.data(), pb.data());
+        left_.Robot2Sensor(pb.data(), b_.data());
+        a_ = left_.Rcb() * right_camera.Rbc() * pn;
+    }
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+    {
+        double inv_d = parameters[0][0];
+        Vector3d pc = a_ / inv_d + b_;
+        Vector2d pixel;
+        left_.Sensor2Pixel(pc.data(), pixel.data());
+        Eigen::Map<Vector2d> residual(residuals);
+        residual = weight_ * (pixel - left_ob_);
+
+        if (jacobians && jacobians[0])
+        {
+            Eigen::Map<Vector2d> jacobian_inv_d(jacobians[0]);
+            jacobian_inv_d = -weight_ * projection_jacobian(left_, pc) * a_ / (inv_d * inv_d);
+        }
+        return true;
+    }
+
+private:
+    Vector2d left_ob_;
+    Vector3d a_, b_;
+    PinholeModel left_;
+    double weight_;
+};
 
 class PoseOnlyReprojectionError : public ceres::Error
 {
 public:
     PoseOnlyReprojectionError(Vector2d ob, Vector3d pw, Camera::Ptr camera, double weight)
-        : ob_(ob), pw_(pw), camera_(camera), Error(weight) {}
+        : ob_(ob), pw_(pw), camera_(*camera), Error(weight) {}
 
     template <typename T>
     bool operator()(const T *Twc, T *residuals) const
@@ -57,29 +260,29 @@ public:
         T p_p[2];
         T pw[3] = {T(pw_.x()), T(pw_.y()), T(pw_.z())};
         T ob[2] = {T(ob_.x()), T(ob_.y())};
-        Reprojection(pw, Twc, camera_, p_p);
+        camera_.World2Pixel(pw, Twc, p_p);
         residuals[0] = T(weight_) * (p_p[0] - ob[0]);
         residuals[1] = T(weight_) * (p_p[1] - ob[1]);
         return true;
     }
 
+    // analytic jacobians, operator() is kept for evaluation and autodiff
     static ceres::CostFunction *Create(Vector2d ob, Vector3d pw, Camera::Ptr camera, double weight)
     {
-        return (new ceres::AutoDiffCostFunction<PoseOnlyReprojectionError, 2, 7>(
-            new PoseOnlyReprojectionError(ob, pw, camera, weight)));
+        return new PoseOnlyReprojectionCost(ob, pw, camera, weight);
     }
 
 private:
     Vector2d ob_;
     Vector3d pw_;
-    Camera::Ptr camera_;
+    PinholeModel camera_;
 };
 
 class TwoFrameReprojectionError : public ceres::Error
 {
 public:
     TwoFrameReprojectionError(Vector2d first_ob, Vector2d ob, Camera::Ptr left, Camera::Ptr right, double weight)
-        : first_ob_(first_ob), ob_(ob), left_(left), right_(right), Error(weight) {}
+        : first_ob_(first_ob), ob_(ob), left_(*left), right_(*right), Error(weight) {}
 
     template <typename T>
     bool operator()(const T *inv_d, const T *Twc1, const T *Twc2, T *residuals) const
@@ -87,30 +290,30 @@ public:
         T pixel[2], pw[3], pb[3];
         T first_ob[2] = {T(first_ob_.x()), T(first_ob_.y())};
         T ob2[2] = {T(ob_.x()), T(ob_.y())};
-        Pixel2Robot(first_ob, inv_d, right_, pb);
+        right_.Pixel2Robot(first_ob, T(1) / inv_d[0], pb);
         ceres::SE3TransformPoint(Twc1, pb, pw);
-        Reprojection(pw, Twc2, left_, pixel);
+        left_.World2Pixel(pw, Twc2, pixel);
         residuals[0] = T(weight_) * (pixel[0] - ob2[0]);
         residuals[1] = T(weight_) * (pixel[1] - ob2[1]);
         return true;
     }
 
+    // analytic jacobians, operator() is kept for evaluation and autodiff
     static ceres::CostFunction *Create(Vector2d first_ob, Vector2d ob, Camera::Ptr left, Camera::Ptr right, double weight)
     {
-        return (new ceres::AutoDiffCostFunction<TwoFrameReprojectionError, 2, 1, 7, 7>(
-            new TwoFrameReprojectionError(first_ob, ob, left, right, weight)));
+        return new TwoFrameReprojectionCost(first_ob, ob, left, right, weight);
     }
 
 private:
     Vector2d first_ob_, ob_;
-    Camera::Ptr left_, right_;
+    PinholeModel left_, right_;
 };
 
 class TwoCameraReprojectionError : public ceres::Error
 {
 public:
     TwoCameraReprojectionError(Vector2d left_ob, Vector2d right_ob, Camera::Ptr left, Camera::Ptr right, double weight)
-        : left_ob_(left_ob), right_ob_(right_ob), left_(left), right_(right), Error(weight) {}
+        : left_ob_(left_ob), right_ob_(right_ob), left_(*left), right_(*right), Error(weight) {}
 
     template <typename T>
     bool operator()(const T *inv_d, T *residuals) const
@@ -118,22 +321,22 @@ public:
         T pixel[2], pb[3];
         T right_ob[2] = {T(right_ob_.x()), T(right_ob_.y())};
         T left_ob[2] = {T(left_ob_.x()), T(left_ob_.y())};
-        Pixel2Robot(right_ob, inv_d, right_, pb);
-        Robot2Pixel(pb, left_, pixel);
+        right_.Pixel2Robot(right_ob, T(1) / inv_d[0], pb);
+        left_.Robot2Pixel(pb, pixel);
         residuals[0] = T(weight_) * (pixel[0] - left_ob[0]);
         residuals[1] = T(weight_) * (pixel[1] - left_ob[1]);
         return true;
     }
 
+    // analytic jacobians, operator() is kept for evaluation and autodiff
     static ceres::CostFunction *Create(Vector2d left_ob, Vector2d right_ob, Camera::Ptr left, Camera::Ptr right, double weight)
     {
-        return (new ceres::AutoDiffCostFunction<TwoCameraReprojectionError, 2, 1>(
-            new TwoCameraReprojectionError(left_ob, right_ob, left, right, weight)));
+        return new TwoCameraReprojectionCost(left_ob, right_ob, left, right, weight);
     }
 
 private:
     Vector2d left_ob_, right_ob_;
-    Camera::Ptr left_, right_;
+    PinholeModel left_, right_;
 };
 
 } // namespace lvio_fusion
@@ -6,8 +6,10 @@
 #include "lvio_fusion/common.h"
 #include "lvio_fusion/frontend.h"
 #include "lvio_fusion/imu/initializer.h"
+#include "lvio_fusion/imu/propagator.h"
 #include "lvio_fusion/lidar/association.h"
 #include "lvio_fusion/lidar/mapping.h"
+#include "lvio_fusion/loop/archive.h"
 #include "lvio_fusion/loop/relocator.h"
 #include "lvio_fusion/loop/pose_graph.h"
 #include "lvio_fusion/navsat/navsat.h"
@@ -41,14 +43,19 @@ public:
 
     void InputImu(double time, Vector3d acc, Vector3d gyr);
 
+    // latest imu-rate state, lock-free, false if not available
+    bool GetLatestState(imu::State &state);
+
     bool Init(int use_imu, int use_lidar, int use_navsat, int use_loop, int use_adapt);
 
     Frontend::Ptr frontend;
     Backend::Ptr backend;
     Relocator::Ptr relocator;
+    Archive::Ptr archive;
     FeatureAssociation::Ptr association;
     Mapping::Ptr mapping;
     Initializer::Ptr initializer;
+    imu::Propagator::Ptr propagator;
 
 private:
     std::string config_file_path_;
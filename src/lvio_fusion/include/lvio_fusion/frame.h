@@ -26,6 +26,18 @@ public:
 
     Observation GetObservation();
 
+    // number of landmarks observed by both keyframes
+    int GetCovisibility(double time);
+
+    // keyframes sharing landmarks with this keyframe, and the numbers
+    std::map<double, int> GetCovisibility();
+
+    // add n shared landmarks between the keyframe and each of the others, maintained by landmarks
+    static void UpdateCovisibility(Frame::Ptr frame, const std::vector<Frame::Ptr> &others, int n);
+
+    // add n shared landmarks between every pair of the keyframes, under a single lock
+    static void UpdateCovisibility(const std::vector<Frame::Ptr> &frames, int n);
+
     void Clear();
 
     static Frame::Ptr Create();
@@ -55,6 +67,9 @@ public:
     Vector3d Vw;                // Imu linear velocity
     Bias bias;                  // Imu bias
     bool good_imu = false;   // can be used in Imu optimization?
+
+private:
+    std::map<double, int> covisibility_; // time of keyframe -> number of shared landmarks
 };
 
 typedef std::map<double, Frame::Ptr> Frames;
@@ -2,6 +2,8 @@
 #define lvio_fusion_FRONTEND_H
 
 #include "lvio_fusion/common.h"
+#include "lvio_fusion/imu/propagator.h"
+#include "lvio_fusion/visual/budget.h"
 #include "lvio_fusion/visual/local_map.h"
 
 namespace lvio_fusion
@@ -17,6 +19,20 @@ enum class FrontendStatus
     LOST
 };
 
+// correction of poses published by other threads, the frontend applies it at the next frame
+struct Correction
+{
+    typedef std::shared_ptr<Correction> Ptr;
+
+    double time = 0;        // frames after time are moved
+    double last_time = 0;   // keyframes before last_time are already moved by the publisher
+    SE3d transform;         // new pose = transform * old pose
+    bool update_imu = false; // repredict velocities of the moved frames, each side its own
+    bool has_cache = false;
+    std::unordered_map<unsigned long, Vector3d> positions; // landmarks anchored before time
+    std::unordered_map<double, SE3d> poses;                // local keyframes before time
+};
+
 class Frontend
 {
 public:
@@ -30,7 +46,12 @@ public:
 
     void SetBackend(std::shared_ptr<Backend> backend) { backend_ = backend; }
 
-    void UpdateCache();
+    void SetBudget(FeatureBudget::Ptr budget) { budget_ = budget; }
+
+    void SetPropagator(imu::Propagator::Ptr propagator) { propagator_ = propagator; }
+
+    // never blocks on tracking
+    void PostCorrection(Correction::Ptr correction);
 
     void UpdateImu(const Bias &bias_);
 
@@ -63,13 +84,23 @@ private:
 
     void PredictState();
 
+    void ApplyCorrections();
+
+    void UpdateCache(Correction::Ptr correction);
+
     // data
     std::weak_ptr<Backend> backend_;
+    FeatureBudget::Ptr budget_;
+    imu::Propagator::Ptr propagator_;
+    std::mutex mutex_corrections_;
+    std::vector<Correction::Ptr> corrections_; // back buffer, swapped out at the next frame
     std::queue<ImuData> imu_buf_;
     imu::Preintegration::Ptr preintegration_last_kf_; // imu pre integration from last key frame
     SE3d last_frame_pose_cache_;
     SE3d relative_i_j_;
     double dt_ = 0;
+    int num_inliers_ = 0;
+    double keyframe_time_ = 0; // cost time of LocalMap::AddKeyFrame in this frame
 
     // params
     int num_features_init_;
@@ -45,9 +45,9 @@ class Imu : public Sensor
 public:
     typedef std::shared_ptr<Imu> Ptr;
 
-    static int Create(const SE3d &extrinsic, double acc_n, double acc_w, double gyr_n, double gyr_w, double g_norm)
+    static int Create(const SE3d &extrinsic, double acc_n, double acc_w, double gyr_n, double gyr_w, double g_norm, double repropagate_ba = 0, double repropagate_bg = 0)
     {
-        devices_.push_back(Imu::Ptr(new Imu(extrinsic, acc_n, acc_w, gyr_n, gyr_w, g_norm)));
+        devices_.push_back(Imu::Ptr(new Imu(extrinsic, acc_n, acc_w, gyr_n, gyr_w, g_norm, repropagate_ba, repropagate_bg)));
         return devices_.size() - 1;
     }
 
@@ -64,10 +64,12 @@ public:
     double ACC_N, ACC_W;
     double GYR_N, GYR_W;
     double G;
+    double REPROPAGATE_BA, REPROPAGATE_BG; // bias changes to repropagate, smaller ones are corrected in first order, both 0: only on initialization
     bool initialized = false;
 
 private:
-    Imu(const SE3d &extrinsic, double acc_n, double acc_w, double gyr_n, double gyr_w, double g_norm) : Sensor(extrinsic), ACC_N(acc_n), ACC_W(acc_w), GYR_N(gyr_n), GYR_W(gyr_w), G(g_norm) {  }
+    Imu(const SE3d &extrinsic, double acc_n, double acc_w, double gyr_n, double gyr_w, double g_norm, double repropagate_ba, double repropagate_bg)
+        : Sensor(extrinsic), ACC_N(acc_n), ACC_W(acc_w), GYR_N(gyr_n), GYR_W(gyr_w), G(g_norm), REPROPAGATE_BA(repropagate_ba), REPROPAGATE_BG(repropagate_bg) {}
     Imu(const Imu &);
     Imu &operator=(const Imu &);
 
@@ -13,15 +13,44 @@ class Initializer
 public:
     typedef std::shared_ptr<Initializer> Ptr;
 
+    Initializer();
+
+    // apply the finished initialization, or start a new one on the worker
     void Initialize(double init_time, double end_time);
 
     int step = 1;   // 1,2,3: next step 1,2,3; 4: finish;
 
 private:
+    // copies of the init keyframes with their landmarks, optimized by the worker
+    struct Snapshot
+    {
+        typedef std::shared_ptr<Snapshot> Ptr;
+
+        Frames keyframes;                   // original keyframes
+        Frames frames;                      // copies of the keyframes
+        std::vector<Frame::Ptr> neighbors;  // copies of the keyframes observed by the landmarks, pose only
+        std::vector<std::pair<visual::Landmark::Ptr, visual::Landmark::Ptr>> landmarks; // original and copy
+        double prior_a, prior_g;
+        bool initialized;                   // imu is initialized when the snapshot is taken
+        Matrix3d Rwg = Matrix3d::Identity();
+        bool success = false;
+    };
+
+    void InitializerLoop();
+
+    Snapshot::Ptr TakeSnapshot(const Frames &keyframes);
+
+    void Apply(Snapshot::Ptr snapshot);
+
     void EstimateVelAndRwg(Frames keyframes);
 
-    bool Initialize(Frames frames, double prior_a, double prior_g);
+    bool Initialize(Snapshot::Ptr snapshot);
 
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    Snapshot::Ptr running_;     // handed to the worker
+    Snapshot::Ptr finished_;    // waiting to be applied
     Matrix3d Rwg_;  // R of gravity in world frame
     const int num_frames_init = 10;
 };
@@ -18,24 +18,34 @@ class Preintegration
 public:
     typedef std::shared_ptr<Preintegration> Ptr;
 
+    struct Sample
+    {
+        double dt;
+        Vector3d acc, gyr;
+    };
+
     static Preintegration::Ptr Create(const Bias bias)
     {
         Preintegration::Ptr new_preintegration(new Preintegration(bias.linearized_ba, bias.linearized_bg));
         return new_preintegration;
     }
 
+    // deep copy, for optimizations on a snapshot
+    Preintegration::Ptr Clone();
+
+    // preintegration of a followed by b, linearized at bias
+    static Preintegration::Ptr Merge(Preintegration::Ptr a, Preintegration::Ptr b, const Bias &bias);
+
     void Append(double dt, const Vector3d &acc, const Vector3d &gyr, const Vector3d &acc0_, const Vector3d &gyr0_)
     {
-        if (dt_buf.size() == 0)
+        if (buf.empty())
         {
             acc0 = acc0_;
             gyr0 = gyr0_;
             linearized_acc = acc0_;
             linearized_gyr = gyr0_;
         }
-        dt_buf.push_back(dt);
-        acc_buf.push_back(acc);
-        gyr_buf.push_back(gyr);
+        buf.push_back(Sample{dt, acc, gyr});
         Propagate(dt, acc, gyr);
     }
 
@@ -50,6 +60,8 @@ public:
 
     void Propagate(double _dt, const Vector3d &_acc_1, const Vector3d &_gyr_1);
     void Repropagate(const Vector3d &_linearized_ba, const Vector3d &_linearized_bg);
+    // repropagate if the bias is far from the linearized one, otherwise use first-order correction
+    bool Relinearize(const Bias &bias);
 
     Matrix<double, 15, 1> Evaluate(
         const Vector3d &Pi, const Quaterniond &Qi, const Vector3d &Vi, const Vector3d &Bai, const Vector3d &Bgi,
@@ -67,10 +79,16 @@ public:
     Vector3d GetDeltaPosition(const Bias &b_);
     Bias GetDeltaBias(const Bias &b_);
 
+    ~Preintegration();
+
+    // square root of information, computed lazily after propagation
+    Matrix<double, 15, 15> SqrtInfo();
+    // square root of information whose bias blocks are replaced by priors
+    Matrix<double, 15, 15> SqrtInfo(double prior_a, double prior_g);
+
     double dt;
     double sum_dt;
-    std::vector<double> dt_buf;
-    std::vector<Vector3d> acc_buf, gyr_buf;
+    std::vector<Sample> buf; // buffer of samples for repropagation, recycled by a per-thread pool
     Vector3d acc0, gyr0;
     Vector3d acc1, gyr1;
     Vector3d linearized_acc, linearized_gyr;
@@ -81,13 +99,18 @@ public:
     Vector3d delta_v;
     Matrix<double, 6, 1> delta_bias;
     Matrix<double, 15, 15> jacobian, covariance;
-    Matrix<double, 15, 15> step_jacobian;
-    Matrix<double, 15, 18> step_V;
     Matrix<double, 18, 18> noise;
 
 private:
     Preintegration() = default;
     Preintegration(const Vector3d &_linearized_ba, const Vector3d &_linearized_bg);
+    Preintegration(const Preintegration &);
+    Preintegration &operator=(const Preintegration &);
+
+    std::mutex mutex_sqrt_info_;
+    bool sqrt_info_valid_ = false, sqrt_info_prior_valid_ = false;
+    double prior_a_ = 0, prior_g_ = 0;
+    Matrix<double, 15, 15> sqrt_info_, sqrt_info_prior_;
 };
 
 typedef std::map<double, Preintegration::Ptr> PreIntegrations;
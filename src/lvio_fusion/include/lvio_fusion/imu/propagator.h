@@ -0,0 +1,81 @@
+#ifndef lvio_fusion_PROPAGATOR_H
+#define lvio_fusion_PROPAGATOR_H
+
+#include "lvio_fusion/common.h"
+#include "lvio_fusion/imu/imu.h"
+#include "lvio_fusion/imu/preintegration.h"
+
+#include <atomic>
+#include <deque>
+
+namespace lvio_fusion
+{
+
+namespace imu
+{
+
+// state of the robot at imu rate
+struct State
+{
+    double time = 0;
+    SE3d pose;                      // pose of the robot in the world
+    Vector3d v = Vector3d::Zero();  // velocity in the world
+    Vector3d w = Vector3d::Zero();  // bias-compensated angular rate in the robot
+};
+
+// forward-propagates the latest tracked frame with every imu sample,
+// the result is published into a lock-free slot which can be read from any thread
+class Propagator
+{
+public:
+    typedef std::shared_ptr<Propagator> Ptr;
+
+    /**
+     * @param max_time      max time of pure imu propagation (seconds)
+     */
+    Propagator(double max_time = 1) : max_time_(max_time) {}
+
+    /**
+     * restart propagation from a tracked frame, samples after it are replayed
+     * @param time      time of the frame
+     * @param pose      pose of the frame
+     * @param v         velocity of the frame
+     * @param bias      bias of the frame
+     */
+    void Reset(double time, const SE3d &pose, const Vector3d &v, const Bias &bias);
+
+    void Propagate(double time, const Vector3d &acc, const Vector3d &gyr);
+
+    /**
+     * read the latest state without blocking
+     * @return false if nothing is published yet
+     */
+    bool Get(State &state) const;
+
+private:
+    void Integrate(const ImuData &sample);
+
+    void Publish(const State &state);
+
+    // writers, serialized by mutex_
+    std::mutex mutex_;
+    std::deque<ImuData> samples_; // samples in the last max_time_
+    Preintegration::Ptr preintegration_;
+    double origin_time_ = 0, last_time_ = 0;
+    SE3d origin_pose_;
+    Vector3d origin_v_;
+    Bias bias_;
+    ImuData last_sample_;
+    const double max_time_;
+
+    // seqlock of the latest state: time, pose(7), v(3), w(3)
+    static const int num_values = 14;
+    std::atomic<unsigned> sequence_{0};
+    std::atomic<double> slot_[num_values];
+};
+
+} // namespace imu
+
+} // namespace lvio_fusion
+
+#endif // lvio_fusion_PROPAGATOR_H
@@ -3,6 +3,8 @@
 
 #include "lvio_fusion/common.h"
 
+#include <pcl/kdtree/kdtree_flann.h>
+
 namespace lvio_fusion
 {
 
@@ -25,6 +27,10 @@ public:
     PointICloud points_surf;
     PointICloud points_ground;
     // PointICloud points_full;
+
+    // kd-trees of the points, only built for the map frames
+    pcl::KdTreeFLANN<PointI>::Ptr kdtree_surf;
+    pcl::KdTreeFLANN<PointI>::Ptr kdtree_ground;
 };
 
 } // namespace lidar
@@ -7,22 +7,29 @@
 namespace lvio_fusion
 {
 
+class Backend;
+
 class Mapping
 {
 public:
     typedef std::shared_ptr<Mapping> Ptr;
 
-    Mapping() {}
+    Mapping();
 
     void SetFeatureAssociation(FeatureAssociation::Ptr association) { association_ = association; }
 
-    void Optimize(Frames &active_kfs);
+    void SetBackend(std::shared_ptr<Backend> backend) { backend_ = backend; }
+
+    // queue the keyframes leaving the backend window, registered by the mapping thread
+    void AddKeyFrames(const Frames &kfs);
 
-    void BuildOldMapFrame(Frame::Ptr old_frame, Frame::Ptr map_frame);
+    // map around the old frame, nullptr if there is no lidar frame
+    Frame::Ptr BuildOldMapFrame(Frame::Ptr old_frame);
 
     void MergeScan(const PointICloud &in, SE3d from_pose, PointICloud &out);
 
-    void BuildMapFrame(Frame::Ptr frame, Frame::Ptr map_frame);
+    // map of the last lidar frames, nullptr if there is no lidar frame
+    Frame::Ptr BuildMapFrame(Frame::Ptr frame);
 
     void ToWorld(Frame::Ptr frame);
     void ToWorld(double start);
@@ -31,14 +38,40 @@ public:
 
     PointRGBCloud GetGlobalMap();
 
+    // remove the pointclouds of keyframes in [start, end]
+    void RemovePointClouds(double start, double end);
+
     std::map<double, PointRGBCloud> pointclouds_color;
     std::map<double, PointICloud> pointclouds_surf;
     std::map<double, PointICloud> pointclouds_ground;
 
 private:
+    // merged map of some keyframes, valid while their pointclouds and the pose of the map frame stay the same
+    struct MapFrameCache
+    {
+        std::vector<double> stamp; // time and version of the pointcloud of every keyframe, then the pose of the map frame
+        Frame::Ptr map_frame;
+    };
+
+    // the map frame takes the pose of base, shared by the callers and not modified
+    Frame::Ptr BuildMapFrame(const Frames &frames, Frame::Ptr base, MapFrameCache &cache);
+
+    void MappingLoop();
+
+    void Optimize(Frames &active_kfs);
+
     void Color(const PointICloud &points_ground, const PointICloud &points_surf, Frame::Ptr frame, PointRGBCloud &out);
 
     FeatureAssociation::Ptr association_;
+    std::weak_ptr<Backend> backend_;
+    std::mutex mutex_; // pointclouds and caches
+    std::map<double, unsigned long> versions_; // versions of the pointclouds
+    MapFrameCache cache_, cache_old_;          // for mapping and relocation
+
+    std::thread thread_;
+    std::mutex mutex_queue_;
+    std::condition_variable new_kfs_;
+    Frames queue_; // keyframes waiting for mapping
 };
 
 } // namespace lvio_fusion
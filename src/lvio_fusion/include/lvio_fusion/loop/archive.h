@@ -0,0 +1,72 @@
+#ifndef lvio_fusion_ARCHIVE_H
+#define lvio_fusion_ARCHIVE_H
+
+#include "lvio_fusion/backend.h"
+#include "lvio_fusion/common.h"
+#include "lvio_fusion/lidar/mapping.h"
+#include "lvio_fusion/loop/pose_graph.h"
+
+namespace lvio_fusion
+{
+
+// keeps the memory bounded by moving old sections of the map to disk segments
+class Archive
+{
+public:
+    typedef std::shared_ptr<Archive> Ptr;
+
+    /**
+     * @param directory         directory of the segment files
+     * @param time_horizon      archive sections ended earlier than it (seconds), 0: disabled
+     * @param distance_horizon  archive sections ended farther than it along the path (meters), 0: disabled
+     */
+    Archive(const std::string &directory, double time_horizon, double distance_horizon);
+
+    void SetBackend(Backend::Ptr backend) { backend_ = backend; }
+
+    void SetMapping(Mapping::Ptr mapping) { mapping_ = mapping; }
+
+    // the keyframe is in a segment on disk
+    bool Contains(double time);
+
+    // load the segment containing the keyframe back into the map, kept until it gets old again
+    bool Load(double time);
+
+private:
+    // keyframes in [start, end)
+    struct Segment
+    {
+        double start, end;
+        std::string path;
+        bool on_disk = false;
+        double loaded = 0; // time of the latest keyframe when loaded
+        Atlas sections;    // sections and submaps of the pose graph in the segment
+        Atlas submaps;
+    };
+
+    void ArchiveLoop();
+
+    void UpdateOdometer(double end);
+
+    // the time or the distance from the keyframe to the end exceeds the horizon
+    bool IsOld(double time, double end);
+
+    void Save(Segment &segment);
+
+    void Restore(Segment &segment);
+
+    Backend::Ptr backend_;
+    Mapping::Ptr mapping_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::map<double, Segment> segments_;    // start -> segment
+    std::map<double, double> odometer_;     // time of keyframe -> travelled distance
+    const std::string directory_;
+    const double time_horizon_;
+    const double distance_horizon_;
+};
+
+} // namespace lvio_fusion
+
+#endif // lvio_fusion_ARCHIVE_H
@@ -10,6 +10,8 @@
 namespace lvio_fusion
 {
 
+class Backend;
+
 // [A, B, C]
 struct Section
 {
@@ -41,6 +43,8 @@ public:
 
     void SetFrontend(Frontend::Ptr frontend) { frontend_ = frontend; }
 
+    void SetBackend(std::shared_ptr<Backend> backend) { backend_ = backend; }
+
     Section &AddSubMap(double old_time, double start_time, double end_time);
 
     Atlas FilterOldSubmaps(double start, double end);
@@ -52,11 +56,22 @@ public:
 
     bool AddSection(double time);
 
+    // the keyframe is an end of a section or a submap
+    bool IsAnchor(double time);
+
+    // move the sections and submaps within [start, end] out of the pose graph
+    void ExtractSections(double start, double end, Atlas &sections, Atlas &submaps);
+
+    // put back the extracted sections and submaps
+    void RestoreSections(const Atlas &sections, const Atlas &submaps);
+
     void BuildProblem(Atlas &sections, Section &submap, adapt::Problem &problem);
 
     void Optimize(Atlas &sections, Section &submap, adapt::Problem &problem);
 
-    void ForwardUpdate(SE3d transfrom, double start_time, bool need_lock = true);
+    // move keyframes after start_time up to the active window of the backend, the caller holds the backend lock,
+    // the frontend moves the newer keyframes and its frames at the next frame
+    void ForwardUpdate(SE3d transfrom, double start_time, Correction::Ptr correction = Correction::Ptr());
 
     void ForwardUpdate(SE3d transfrom, const Frames &forward_kfs);
 
@@ -71,6 +86,7 @@ private:
     PoseGraph &operator=(const PoseGraph &);
 
     Frontend::Ptr frontend_;
+    std::weak_ptr<Backend> backend_;
 
     Atlas submaps_;  // loop submaps [end : {old, start, end}]
     Atlas sections_; // sections [A : {A, B, C}]
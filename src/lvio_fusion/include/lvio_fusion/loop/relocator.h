@@ -8,6 +8,7 @@
 #include "lvio_fusion/frontend.h"
 #include "lvio_fusion/lidar/association.h"
 #include "lvio_fusion/lidar/mapping.h"
+#include "lvio_fusion/loop/archive.h"
 #include "lvio_fusion/loop/loop.h"
 #include "lvio_fusion/loop/pose_graph.h"
 
@@ -25,6 +26,8 @@ public:
 
     void SetBackend(Backend::Ptr backend) { backend_ = backend; }
 
+    void SetArchive(Archive::Ptr archive) { archive_ = archive; }
+
 private:
     enum Mode
     {
@@ -49,6 +52,7 @@ private:
 
     Mapping::Ptr mapping_;
     Backend::Ptr backend_;
+    Archive::Ptr archive_;
 
     std::thread thread_;
     Mode mode_;
@@ -29,18 +29,25 @@ public:
 
     void InsertKeyFrame(Frame::Ptr frame);
 
+    void RemoveKeyFrame(Frame::Ptr frame);
+
     void InsertLandmark(visual::Landmark::Ptr landmark);
 
     void RemoveLandmark(visual::Landmark::Ptr landmark);
 
+    // approximate bytes used by the landmarks and their observations
+    size_t LandmarkMemory();
+
     SE3d ComputePose(double time);
 
-    void ApplyGravityRotation(const Matrix3d &R);
+    // rotate keyframes before end (0: all keyframes)
+    void ApplyGravityRotation(const Matrix3d &R, double end = 0);
 
     void Reset()
     {
         landmarks.clear();
         keyframes.clear();
+        visual::Landmark::num_observations = 0;
     }
     
     std::mutex mutex_local_kfs;
@@ -4,6 +4,7 @@
 // utilities used in lvio_fusion
 #include "lvio_fusion/common.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 
 #include <opencv2/core/eigen.hpp>
@@ -139,6 +140,17 @@ inline Matrix<typename Derived::Scalar, 4, 4> q_right(const QuaternionBase<Deriv
     return ans;
 }
 
+// jacobian of ceres::EigenQuaternionParameterization::Plus at zero, q' = [sin(delta), cos(delta)] * q
+inline Matrix<double, 4, 3> q_plus_jacobian(const Quaterniond &q)
+{
+    Matrix<double, 4, 3> ans;
+    ans << q.w(), q.z(), -q.y(),
+        -q.z(), q.w(), q.x(),
+        q.y(), -q.x(), q.w(),
+        -q.x(), -q.y(), -q.z();
+    return ans;
+}
+
 template <typename Derived>
 inline Matrix<typename Derived::Scalar, 3, 3> ypr2R(const MatrixBase<Derived> &ypr)
 {
@@ -224,6 +236,29 @@ inline bool operator==(SE3d &a, SE3d &b)
     Quaterniond qa = a.unit_quaternion(), qb = b.unit_quaternion();
     return a.translation() == b.translation() && qa == qb;
 }
+
+// call f(i) for i in [0, n) on at most num_threads threads
+template <typename Func>
+inline void parallel_for(int n, Func f)
+{
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < n; i = next++)
+        {
+            f(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < std::min(n, num_threads); i++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
 } // namespace lvio_fusion
 
 #endif // lvio_fusion_UTILITY_H
@@ -0,0 +1,52 @@
+#ifndef lvio_fusion_BUDGET_H
+#define lvio_fusion_BUDGET_H
+
+#include "lvio_fusion/common.h"
+
+namespace lvio_fusion
+{
+
+// closed-loop controller of the feature budget, holds the frontend's cost per frame under a target
+class FeatureBudget
+{
+public:
+    typedef std::shared_ptr<FeatureBudget> Ptr;
+
+    /**
+     * @param frame_time            target cost time of Frontend::AddFrame (seconds)
+     * @param min_features          lower bound of extractor's num_features
+     * @param max_features          upper bound of extractor's num_features
+     * @param min_for_keyframe      lower bound of num_features_needed_for_keyframe
+     * @param max_for_keyframe      upper bound of num_features_needed_for_keyframe
+     * @param tracking_bad          inliers must be kept above num_features_tracking_bad
+     */
+    FeatureBudget(double frame_time, int min_features, int max_features, int min_for_keyframe, int max_for_keyframe, int tracking_bad)
+        : frame_time_(frame_time), min_features_(min_features), max_features_(max_features),
+          min_for_keyframe_(std::max(min_for_keyframe, tracking_bad + 1)), max_for_keyframe_(max_for_keyframe),
+          tracking_bad_(tracking_bad) {}
+
+    /**
+     * feed the measured timings of the last frame
+     * @param frame_time        cost time of Frontend::AddFrame
+     * @param keyframe_time     cost time of LocalMap::AddKeyFrame, 0 if the frame is not a keyframe
+     * @param num_inliers       tracked inliers of the frame
+     * @param num_features      in: current extractor budget;        out: new extractor budget
+     * @param for_keyframe      in: current keyframe threshold;      out: new keyframe threshold
+     */
+    void Update(double frame_time, double keyframe_time, int num_inliers, int &num_features, int &for_keyframe);
+
+private:
+    const double frame_time_;
+    const int min_features_, max_features_;
+    const int min_for_keyframe_, max_for_keyframe_;
+    const int tracking_bad_;
+
+    double avg_tracking_time_ = 0; // average cost time of tracking, excluding keyframes
+    double avg_keyframe_time_ = 0; // average cost time of LocalMap::AddKeyFrame
+    double avg_inliers_ = 0;       // average tracked inliers
+    const double alpha_ = 0.1;     // smoothing factor of averages
+};
+
+} // namespace lvio_fusion
+
+#endif // lvio_fusion_BUDGET_H
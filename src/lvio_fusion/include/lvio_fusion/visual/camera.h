@@ -66,6 +66,25 @@ public:
         return Sensor2Pixel(World2Sensor(pw, Tcw));
     }
 
+    /**
+     * batch transform: world -> pixel, the transform is composed only once
+     * @param pws       3xN points in the world
+     * @param Twc       pose of the robot
+     * @param pixels    2xN points in the pixel
+     * @param depths    N depths in the sensor
+     * @param far       N flags, true if the point is far
+     */
+    void World2Pixel(const Matrix3Xd &pws, const SE3d &Twc, Matrix2Xd &pixels, VectorXd &depths, Array<bool, Dynamic, 1> &far)
+    {
+        SE3d Tcw = (Twc * extrinsic).inverse();
+        Matrix3Xd pcs = (Tcw.rotationMatrix() * pws).colwise() + Tcw.translation();
+        depths = pcs.row(2).transpose();
+        pixels.resize(2, pws.cols());
+        pixels.row(0) = (fx * pcs.row(0).array() / pcs.row(2).array() + cx).matrix();
+        pixels.row(1) = (fy * pcs.row(1).array() / pcs.row(2).array() + cy).matrix();
+        far = depths.array() > baseline * 50;
+    }
+
     Vector3d Pixel2Robot(const Vector2d &pp, double depth = 1)
     {
         return Sensor2Robot(Pixel2Sensor(pp, depth));
@@ -0,0 +1,156 @@
+#ifndef lvio_fusion_CAMERA_MODEL_H
+#define lvio_fusion_CAMERA_MODEL_H
+
+#include "lvio_fusion/common.h"
+#include "lvio_fusion/visual/camera.h"
+
+namespace lvio_fusion
+{
+
+namespace camera
+{
+
+// no distortion, images are undistorted before tracking
+struct Pinhole
+{
+    static constexpr bool identity = true;
+
+    template <typename T>
+    static void Distort(const double *k, const T *pn, T *pd)
+    {
+        pd[0] = pn[0];
+        pd[1] = pn[1];
+    }
+};
+
+// camera model specialized at compile time, the extrinsic and its inverse are computed once,
+// all transforms work on both doubles and ceres::Jet
+template <typename Distortion>
+class Model
+{
+public:
+    Model() {}
+
+    explicit Model(const Camera &camera)
+        : fx(camera.fx), fy(camera.fy), cx(camera.cx), cy(camera.cy)
+    {
+        // radial-tangential coefficients of the camera, ignored by Pinhole
+        k_[0] = camera.k1;
+        k_[1] = camera.k2;
+        k_[2] = camera.p1;
+        k_[3] = camera.p2;
+        SetExtrinsic(camera.extrinsic);
+    }
+
+    void SetExtrinsic(const SE3d &extrinsic)
+    {
+        SE3d extrinsic_inverse = extrinsic.inverse();
+        Eigen::Map<Matrix<double, 3, 3, RowMajor>>(Rbc_) = extrinsic.rotationMatrix();
+        Eigen::Map<Matrix<double, 3, 3, RowMajor>>(Rcb_) = extrinsic_inverse.rotationMatrix();
+        Eigen::Map<Vector3d>(tbc_) = extrinsic.translation();
+        Eigen::Map<Vector3d>(tcb_) = extrinsic_inverse.translation();
+    }
+
+    // rotation of the extrinsic's inverse
+    Matrix3d Rcb() const
+    {
+        return Eigen::Map<const Matrix<double, 3, 3, RowMajor>>(Rcb_);
+    }
+
+    // rotation of the extrinsic
+    Matrix3d Rbc() const
+    {
+        return Eigen::Map<const Matrix<double, 3, 3, RowMajor>>(Rbc_);
+    }
+
+    // coordinate transform: robot, sensor, pixel
+    template <typename T>
+    void Sensor2Pixel(const T *pc, T *pp) const
+    {
+        T pn[2] = {pc[0] / pc[2], pc[1] / pc[2]}, pd[2];
+        Distortion::Distort(k_, pn, pd);
+        pp[0] = fx * pd[0] + cx;
+        pp[1] = fy * pd[1] + cy;
+    }
+
+    template <typename T>
+    void Pixel2Sensor(const T *pp, const T &depth, T *pc) const
+    {
+        T pd[2] = {(pp[0] - cx) / fx, (pp[1] - cy) / fy};
+        T pn[2] = {pd[0], pd[1]};
+        if (!Distortion::identity)
+        {
+            // fixed-point undistortion
+            T p[2];
+            for (int i = 0; i < 5; i++)
+            {
+                Distortion::Distort(k_, pn, p);
+                pn[0] = pd[0] - (p[0] - pn[0]);
+                pn[1] = pd[1] - (p[1] - pn[1]);
+            }
+        }
+        pc[0] = pn[0] * depth;
+        pc[1] = pn[1] * depth;
+        pc[2] = depth;
+    }
+
+    template <typename T>
+    void Robot2Sensor(const T *pb, T *pc) const
+    {
+        Transform(Rcb_, tcb_, pb, pc);
+    }
+
+    template <typename T>
+    void Sensor2Robot(const T *pc, T *pb) const
+    {
+        Transform(Rbc_, tbc_, pc, pb);
+    }
+
+    template <typename T>
+    void Robot2Pixel(const T *pb, T *pp) const
+    {
+        T pc[3];
+        Robot2Sensor(pb, pc);
+        Sensor2Pixel(pc, pp);
+    }
+
+    template <typename T>
+    void Pixel2Robot(const T *pp, const T &depth, T *pb) const
+    {
+        T pc[3];
+        Pixel2Sensor(pp, depth, pc);
+        Sensor2Robot(pc, pb);
+    }
+
+    template <typename T>
+    void World2Pixel(const T *pw, const T *Twc, T *pp) const
+    {
+        T Twc_i[7], pb[3];
+        ceres::SE3Inverse(Twc, Twc_i);
+        ceres::SE3TransformPoint(Twc_i, pw, pb);
+        Robot2Pixel(pb, pp);
+    }
+
+    double fx = 0, fy = 0, cx = 0, cy = 0;
+
+private:
+    template <typename T>
+    static void Transform(const double *R, const double *t, const T *p, T *result)
+    {
+        result[0] = R[0] * p[0] + R[1] * p[1] + R[2] * p[2] + t[0];
+        result[1] = R[3] * p[0] + R[4] * p[1] + R[5] * p[2] + t[1];
+        result[2] = R[6] * p[0] + R[7] * p[1] + R[8] * p[2] + t[2];
+    }
+
+    double k_[4] = {0, 0, 0, 0};
+    double Rcb_[9], tcb_[3]; // inverse of extrinsic
+    double Rbc_[9], tbc_[3]; // extrinsic
+};
+
+} // namespace camera
+
+typedef camera::Model<camera::Pinhole> PinholeModel;
+
+} // namespace lvio_fusion
+
+#endif // lvio_fusion_CAMERA_MODEL_H
@@ -32,7 +32,10 @@ public:
     // compute the ORB descriptors after detecting.
     cv::Mat Compute(std::vector<std::vector<cv::KeyPoint>> &keypoints);
 
-    const int num_features;
+    // change the number of features, and redistribute them on the levels.
+    void SetNumFeatures(int nfeatures);
+
+    int num_features;
     const double scale_factor;
     const int num_levels;
     const int init_FAST_thershold;
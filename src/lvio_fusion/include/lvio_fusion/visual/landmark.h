@@ -3,6 +3,8 @@
 
 #include "lvio_fusion/visual/feature.h"
 
+#include <atomic>
+
 namespace lvio_fusion
 {
 
@@ -11,10 +13,17 @@ namespace visual
 class Landmark
 {
 public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
     typedef std::shared_ptr<Landmark> Ptr;
 
+    // copy for snapshots, without the cached position
+    Landmark(const Landmark &landmark)
+        : id(landmark.id), inv_depth(landmark.inv_depth), observations(landmark.observations), first_observation(landmark.first_observation) {}
+
+    // position in the world, recomputed only if the anchor frame moved or the depth changed
     Vector3d ToWorld();
 
+    // remove all observations from their frames, the covisibility is updated in one pass
     void Clear();
 
     std::weak_ptr<Frame> FirstFrame();
@@ -27,6 +36,7 @@ public:
     static Landmark::Ptr Create(double depth);
 
     static unsigned long current_landmark_id;
+    static std::atomic<unsigned long> num_observations; // left observations of all landmarks
     unsigned long id = 0;           // ID
     double inv_depth;               // inverse depth in the first observation
     Features observations;          // only for left feature
@@ -37,6 +47,13 @@ private:
     {
         id = ++current_landmark_id;
     }
+
+    // stamp of the cached position: the anchor pose and inverse depth it is computed from
+    std::mutex mutex_cache_;
+    bool cached_ = false;
+    SE3d cached_pose_;
+    double cached_inv_depth_ = 0;
+    Vector3d cached_position_;
 };
 
 typedef std::unordered_map<unsigned long, Landmark::Ptr> Landmarks;
@@ -43,6 +43,19 @@ public:
 
     void UpdateCache();
 
+    // positions of landmarks and poses of keyframes before time, called by other threads
+    void ComputeCache(double time, std::unordered_map<unsigned long, Vector3d> &positions, std::unordered_map<double, SE3d> &poses);
+
+    // use the cache from ComputeCache, update the rest
+    void UpdateCache(double time, std::unordered_map<unsigned long, Vector3d> &positions, std::unordered_map<double, SE3d> &poses);
+
+    void SetNumFeatures(int num_features);
+
+    int NumFeatures() { return num_features_; }
+
+    // the keyframe has features in the local map
+    bool Contains(double time);
+
     std::unordered_map<unsigned long, Vector3d> position_cache;
     std::unordered_map<double, SE3d> pose_cache;
     visual::Landmarks landmarks;
@@ -72,7 +85,7 @@ private:
 
     const int num_levels_;
     const int windows_size_ = 4;
-    const int num_features_;
+    int num_features_;
 };
 } // namespace lvio_fusion
 
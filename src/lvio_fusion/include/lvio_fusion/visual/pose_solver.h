@@ -0,0 +1,44 @@
+#ifndef lvio_fusion_POSE_SOLVER_H
+#define lvio_fusion_POSE_SOLVER_H
+
+#include "lvio_fusion/common.h"
+#include "lvio_fusion/visual/camera_model.h"
+
+namespace lvio_fusion
+{
+
+// motion-only Gauss-Newton solver of the robot pose, runs every frame without building a ceres problem
+class PoseSolver
+{
+public:
+    /**
+     * @param camera            camera which observes the points
+     * @param huber             threshold of huber weighting (pixels)
+     * @param max_iterations    max iterations of Gauss-Newton
+     */
+    PoseSolver(Camera::Ptr camera, double huber = 2, int max_iterations = 5)
+        : camera_(*camera), Rcb_(camera->extrinsic.inverse().rotationMatrix()), huber_(huber), max_iterations_(max_iterations) {}
+
+    /**
+     * refine the pose with 3D-2D correspondences
+     * @param points_3d     points in the world
+     * @param points_2d     observations in the pixel
+     * @param pose          in: predicted pose of the robot;     out: refined pose
+     * @return number of inliers
+     */
+    int Solve(const std::vector<cv::Point3f> &points_3d, const std::vector<cv::Point2f> &points_2d, SE3d &pose);
+
+private:
+    // build the normal equation at Tbw, return the huber cost
+    double Linearize(const std::vector<cv::Point3f> &points_3d, const std::vector<cv::Point2f> &points_2d, const SE3d &Tbw,
+                     Matrix<double, 6, 6> &H, Matrix<double, 6, 1> &b, int &num_inliers);
+
+    PinholeModel camera_;
+    Matrix3d Rcb_;
+    const double huber_;
+    const int max_iterations_;
+};
+
+} // namespace lvio_fusion
+
+#endif // lvio_fusion_POSE_SOLVER_H
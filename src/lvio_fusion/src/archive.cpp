@@ -0,0 +1,393 @@
+#include "lvio_fusion/loop/archive.h"
+#include "lvio_fusion/lidar/lidar.h"
+#include "lvio_fusion/map.h"
+#include "lvio_fusion/visual/landmark.h"
+
+#include <fstream>
+#include <sys/stat.h>
+
+namespace lvio_fusion
+{
+
+template <typename T>
+inline void write(std::ofstream &out, const T &value)
+{
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+inline void read(std::ifstream &in, T &value)
+{
+    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+inline void write_cloud(std::ofstream &out, const PointICloud &cloud)
+{
+    write(out, cloud.size());
+    for (auto &point : cloud)
+    {
+        write(out, point.x);
+        write(out, point.y);
+        write(out, point.z);
+        write(out, point.intensity);
+    }
+}
+
+inline void read_cloud(std::ifstream &in, PointICloud &cloud)
+{
+    size_t size;
+    read(in, size);
+    cloud.resize(size);
+    for (auto &point : cloud)
+    {
+        read(in, point.x);
+        read(in, point.y);
+        read(in, point.z);
+        read(in, point.intensity);
+    }
+}
+
+Archive::Archive(const std::string &directory, double time_horizon, double distance_horizon)
+    : directory_(directory), time_horizon_(time_horizon), distance_horizon_(distance_horizon)
+{
+    mkdir(directory_.c_str(), 0755);
+    thread_ = std::thread(std::bind(&Archive::ArchiveLoop, this));
+}
+
+void Archive::ArchiveLoop()
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        double end = backend_ ? backend_->finished : 0;
+        if (end == 0)
+            continue;
+        UpdateOdometer(end);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        // loaded segments go back to disk when they get old again
+        double keep = end;
+        for (auto &pair : segments_)
+        {
+            Segment &segment = pair.second;
+            if (!segment.on_disk)
+            {
+                if (IsOld(segment.loaded, end))
+                {
+                    Save(segment);
+                }
+                else
+                {
+                    keep = std::min(keep, segment.loaded);
+                }
+            }
+        }
+
+        // new segments are the old sections of the pose graph
+        Atlas sections = PoseGraph::Instance().GetSections(0, end);
+        for (auto &pair : sections)
+        {
+            Section &section = pair.second;
+            if (section.C >= end || !IsOld(section.C, end))
+            {
+                keep = std::min(keep, section.A);
+                break;
+            }
+            // reloaded segments stay in the map until they get old again
+            auto iter = segments_.find(section.A);
+            if (iter != segments_.end() && !iter->second.on_disk && !IsOld(iter->second.loaded, end))
+                continue;
+            Segment &segment = segments_[section.A];
+            segment.start = section.A;
+            segment.end = section.C;
+            segment.path = directory_ + "/" + std::to_string(section.A) + ".bin";
+            Save(segment);
+        }
+        odometer_.erase(odometer_.begin(), odometer_.lower_bound(keep));
+    }
+}
+
+void Archive::UpdateOdometer(double end)
+{
+    double start = odometer_.empty() ? 0 : (--odometer_.end())->first + epsilon;
+    Frames frames = Map::Instance().GetKeyFrames(start, end);
+    static Vector3d last_position;
+    for (auto &pair : frames)
+    {
+        double distance = odometer_.empty() ? 0 : (--odometer_.end())->second + (pair.second->t() - last_position).norm();
+        odometer_[pair.first] = distance;
+        last_position = pair.second->t();
+    }
+}
+
+bool Archive::IsOld(double time, double end)
+{
+    if (time_horizon_ > 0 && end - time > time_horizon_)
+        return true;
+    if (distance_horizon_ > 0 && !odometer_.empty())
+    {
+        auto iter = odometer_.lower_bound(time);
+        if (iter != odometer_.end() && (--odometer_.end())->second - iter->second > distance_horizon_)
+            return true;
+    }
+    return false;
+}
+
+bool Archive::Contains(double time)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto iter = segments_.upper_bound(time);
+    if (iter == segments_.begin())
+        return false;
+    iter--;
+    return iter->second.on_disk && time < iter->second.end;
+}
+
+bool Archive::Load(double time)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto iter = segments_.upper_bound(time);
+    if (iter == segments_.begin())
+        return false;
+    Segment &segment = (--iter)->second;
+    if (!segment.on_disk || time >= segment.end)
+        return false;
+    Restore(segment);
+    segment.loaded = backend_->finished;
+    return !segment.on_disk;
+}
+
+// file: keyframes, then the landmarks first observed in them
+void Archive::Save(Segment &segment)
+{
+    Frames frames = Map::Instance().GetKeyFrames(segment.start, segment.end - epsilon);
+    std::vector<visual::Landmark::Ptr> landmarks;
+    std::ofstream out(segment.path, std::ios::binary | std::ios::trunc);
+    write(out, frames.size());
+    for (auto &pair : frames)
+    {
+        Frame::Ptr frame = pair.second;
+        write(out, frame->id);
+        write(out, frame->time);
+        out.write(reinterpret_cast<const char *>(frame->pose.data()), sizeof(double) * SE3d::num_parameters);
+        write(out, frame->Vw);
+        write(out, frame->bias);
+        write(out, frame->good_imu);
+        write(out, (bool)frame->feature_lidar);
+        if (frame->feature_lidar)
+        {
+            write_cloud(out, frame->feature_lidar->points_surf);
+            write_cloud(out, frame->feature_lidar->points_ground);
+        }
+        write(out, (bool)frame->feature_navsat);
+        if (frame->feature_navsat)
+        {
+            write(out, frame->feature_navsat->time);
+            write(out, frame->feature_navsat->cov);
+        }
+        for (auto &pair_feature : frame->features_left)
+        {
+            auto landmark = pair_feature.second->landmark.lock();
+            if (landmark->FirstFrame().lock() == frame)
+            {
+                landmarks.push_back(landmark);
+            }
+        }
+    }
+    write(out, landmarks.size());
+    for (auto &landmark : landmarks)
+    {
+        write(out, landmark->id);
+        write(out, landmark->inv_depth);
+        write(out, landmark->first_observation->keypoint.pt);
+        // observations are sorted by frame id, the first one is the host
+        std::vector<visual::Feature::Ptr> observations;
+        for (auto &pair_feature : landmark->observations)
+        {
+            if (frames.find(pair_feature.second->frame.lock()->time) != frames.end())
+            {
+                observations.push_back(pair_feature.second);
+            }
+        }
+        write(out, observations.size());
+        for (auto &feature : observations)
+        {
+            write(out, feature->frame.lock()->time);
+            write(out, feature->keypoint.pt);
+        }
+    }
+    if (!out)
+    {
+        LOG(ERROR) << "Failed to archive segment " << segment.path;
+        return;
+    }
+
+    // remove from the map under the backend lock, then from the pose graph and the pointclouds
+    {
+        std::unique_lock<std::mutex> lock(backend_->mutex);
+        for (auto &landmark : landmarks)
+        {
+            Map::Instance().RemoveLandmark(landmark);
+        }
+        for (auto &pair : frames)
+        {
+            Frame::Ptr frame = pair.second;
+            visual::Features features = frame->features_left;
+            for (auto &pair_feature : features)
+            {
+                pair_feature.second->landmark.lock()->RemoveObservation(pair_feature.second);
+                frame->RemoveFeature(pair_feature.second);
+            }
+            Map::Instance().RemoveKeyFrame(frame);
+        }
+        Frames next_kfs = Map::Instance().GetKeyFrames(segment.end - epsilon, 0, 1);
+        if (!next_kfs.empty())
+        {
+            Frame::Ptr next_frame = next_kfs.begin()->second;
+            if (next_frame->last_keyframe && frames.find(next_frame->last_keyframe->time) != frames.end())
+            {
+                next_frame->last_keyframe = nullptr;
+            }
+        }
+        // frames referred by loop closures live on, without their data
+        for (auto &pair : frames)
+        {
+            Frame::Ptr frame = pair.second;
+            frame->last_keyframe = nullptr;
+            frame->features_right.clear();
+            frame->feature_lidar = nullptr;
+            frame->preintegration = nullptr;
+            frame->preintegration_last = nullptr;
+            frame->image_left.release();
+            frame->image_right.release();
+            frame->descriptors.release();
+        }
+    }
+    if (mapping_)
+    {
+        mapping_->RemovePointClouds(segment.start, segment.end - epsilon);
+    }
+    segment.sections.clear();
+    segment.submaps.clear();
+    PoseGraph::Instance().ExtractSections(segment.start, segment.end, segment.sections, segment.submaps);
+    segment.on_disk = true;
+    LOG(INFO) << "Archive " << frames.size() << " keyframes and " << landmarks.size() << " landmarks to " << segment.path;
+}
+
+void Archive::Restore(Segment &segment)
+{
+    std::ifstream in(segment.path, std::ios::binary);
+    Frames frames;
+    Frame::Ptr last_frame;
+    size_t num_frames;
+    read(in, num_frames);
+    for (size_t i = 0; i < num_frames && in; i++)
+    {
+        Frame::Ptr frame(new Frame);
+        read(in, frame->id);
+        read(in, frame->time);
+        in.read(reinterpret_cast<char *>(frame->pose.data()), sizeof(double) * SE3d::num_parameters);
+        read(in, frame->Vw);
+        read(in, frame->bias);
+        read(in, frame->good_imu);
+        bool has_lidar, has_navsat;
+        read(in, has_lidar);
+        if (has_lidar)
+        {
+            frame->feature_lidar = lidar::Feature::Create();
+            read_cloud(in, frame->feature_lidar->points_surf);
+            read_cloud(in, frame->feature_lidar->points_ground);
+        }
+        read(in, has_navsat);
+        if (has_navsat)
+        {
+            double time;
+            Vector3d cov;
+            read(in, time);
+            read(in, cov);
+            frame->feature_navsat = navsat::Feature::Ptr(new navsat::Feature(time, cov));
+        }
+        frame->last_keyframe = last_frame;
+        last_frame = frame;
+        frames[frame->time] = frame;
+    }
+    size_t num_landmarks;
+    read(in, num_landmarks);
+    std::vector<visual::Landmark::Ptr> landmarks;
+    for (size_t i = 0; i < num_landmarks && in; i++)
+    {
+        unsigned long id;
+        double inv_depth;
+        cv::Point2f pt_right;
+        size_t num_observations;
+        read(in, id);
+        read(in, inv_depth);
+        read(in, pt_right);
+        read(in, num_observations);
+        auto landmark = visual::Landmark::Create(inv_depth);
+        landmark->id = id;
+        for (size_t j = 0; j < num_observations && in; j++)
+        {
+            double time;
+            cv::Point2f pt;
+            read(in, time);
+            read(in, pt);
+            auto iter = frames.find(time);
+            if (iter == frames.end())
+            {
+                in.setstate(std::ios::failbit);
+                break;
+            }
+            auto feature = visual::Feature::Create(iter->second, cv::KeyPoint(pt, 1), landmark);
+            landmark->AddObservation(feature);
+            iter->second->AddFeature(feature);
+        }
+        if (!in || landmark->observations.empty())
+            break;
+        Frame::Ptr host = landmark->observations.begin()->second->frame.lock();
+        auto feature_right = visual::Feature::Create(host, cv::KeyPoint(pt_right, 1), landmark);
+        feature_right->is_on_left_image = false;
+        landmark->AddObservation(feature_right);
+        host->AddFeature(feature_right);
+        landmarks.push_back(landmark);
+    }
+    if (!in || landmarks.size() != num_landmarks)
+    {
+        // the loaded frames and landmarks are not in the map yet, just drop them
+        for (auto &landmark : landmarks)
+        {
+            visual::Landmark::num_observations -= landmark->observations.size();
+        }
+        LOG(ERROR) << "Failed to load segment " << segment.path;
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(backend_->mutex);
+        for (auto &landmark : landmarks)
+        {
+            Map::Instance().InsertLandmark(landmark);
+        }
+        {
+            std::unique_lock<std::mutex> lock(Map::Instance().mutex_local_kfs);
+            Map::Instance().keyframes.insert(frames.begin(), frames.end());
+        }
+        Frames next_kfs = Map::Instance().GetKeyFrames(segment.end - epsilon, 0, 1);
+        if (!next_kfs.empty() && !next_kfs.begin()->second->last_keyframe)
+        {
+            next_kfs.begin()->second->last_keyframe = last_frame;
+        }
+    }
+    if (mapping_ && Lidar::Num())
+    {
+        for (auto &pair : frames)
+        {
+            mapping_->ToWorld(pair.second);
+        }
+    }
+    PoseGraph::Instance().RestoreSections(segment.sections, segment.submaps);
+    segment.on_disk = false;
+    LOG(INFO) << "Load " << frames.size() << " keyframes and " << landmarks.size() << " landmarks from " << segment.path;
+}
+
+} // namespace lvio_fusion
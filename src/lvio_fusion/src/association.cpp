@@ -269,14 +269,18 @@ inline void FeatureAssociation::SegmentGround(PointICloud &points_ground)
 
 void FeatureAssociation::ScanToMapWithGround(Frame::Ptr frame, Frame::Ptr map_frame, double *para, adapt::Problem &problem, bool relocate)
 {
-    ceres::LossFunction *loss_function = new ceres::TrivialLoss();
+    ceres::LossFunction *loss_function = problem.New<ceres::TrivialLoss>();
     PointICloud &points_ground_last = map_frame->feature_lidar->points_ground;
     problem.AddParameterBlock(para + 1, 1);
     problem.AddParameterBlock(para + 2, 1);
     problem.AddParameterBlock(para + 5, 1);
 
-    pcl::KdTreeFLANN<PointI> kdtree_last;
-    kdtree_last.setInputCloud(boost::make_shared<PointICloud>(points_ground_last));
+    pcl::KdTreeFLANN<PointI>::Ptr kdtree_last = map_frame->feature_lidar->kdtree_ground;
+    if (!kdtree_last)
+    {
+        kdtree_last.reset(new pcl::KdTreeFLANN<PointI>);
+        kdtree_last->setInputCloud(boost::make_shared<PointICloud>(points_ground_last));
+    }
 
     PointI point;
     std::vector<int> points_index;
@@ -293,7 +297,7 @@ void FeatureAssociation::ScanToMapWithGround(Frame::Ptr frame, Frame::Ptr map_fr
         //NOTE: Sophus is too slow
         ceres::SE3TransformPoint(tf, frame->feature_lidar->points_ground[i].data, point.data);
         point.intensity = frame->feature_lidar->points_ground[i].intensity;
-        kdtree_last.nearestKSearch(point, 3, points_index, points_distance);
+        kdtree_last->nearestKSearch(point, 3, points_index, points_distance);
         // clang-format off
         if (points_index[0] < points_ground_last.size() && points_distance[0] < distance_threshold 
          && points_index[1] < points_ground_last.size() && points_distance[1] < distance_threshold 
@@ -327,14 +331,18 @@ void FeatureAssociation::ScanToMapWithGround(Frame::Ptr frame, Frame::Ptr map_fr
 
 void FeatureAssociation::ScanToMapWithSegmented(Frame::Ptr frame, Frame::Ptr map_frame, double *para, adapt::Problem &problem, bool relocate)
 {
-    ceres::LossFunction *loss_function = new ceres::HuberLoss(0.1);
+    ceres::LossFunction *loss_function = problem.New<ceres::HuberLoss>(0.1);
     PointICloud &points_surf_last = map_frame->feature_lidar->points_surf;
     problem.AddParameterBlock(para + 0, 1);
     problem.AddParameterBlock(para + 3, 1);
     problem.AddParameterBlock(para + 4, 1);
 
-    pcl::KdTreeFLANN<PointI> kdtree_last;
-    kdtree_last.setInputCloud(boost::make_shared<PointICloud>(points_surf_last));
+    pcl::KdTreeFLANN<PointI>::Ptr kdtree_last = map_frame->feature_lidar->kdtree_surf;
+    if (!kdtree_last)
+    {
+        kdtree_last.reset(new pcl::KdTreeFLANN<PointI>);
+        kdtree_last->setInputCloud(boost::make_shared<PointICloud>(points_surf_last));
+    }
 
     PointI point;
     std::vector<int> points_index;
@@ -351,7 +359,7 @@ void FeatureAssociation::ScanToMapWithSegmented(Frame::Ptr frame, Frame::Ptr map
         //NOTE: Sophus is too slow
         ceres::SE3TransformPoint(tf, frame->feature_lidar->points_surf[i].data, point.data);
         point.intensity = frame->feature_lidar->points_surf[i].intensity;
-        kdtree_last.nearestKSearch(point, 3, points_index, points_distance);
+        kdtree_last->nearestKSearch(point, 3, points_index, points_distance);
         // clang-format off
         if (points_index[0] < points_surf_last.size() && points_distance[0] < distance_threshold 
          && points_index[1] < points_surf_last.size() && points_distance[1] < distance_threshold 
@@ -10,11 +10,16 @@
 #include "lvio_fusion/visual/feature.h"
 #include "lvio_fusion/visual/landmark.h"
 
+#include <Eigen/Eigenvalues>
+
 namespace lvio_fusion
 {
 
-Backend::Backend(double window_size, bool update_weights)
-    : window_size_(window_size), update_weights_(update_weights)
+Backend::Backend(double window_size, bool update_weights, bool marginalization, bool multi_observation,
+                 int min_kfs, int max_kfs, int min_covisibility, double time_budget, bool culling, int min_observations)
+    : window_size_(window_size), update_weights_(update_weights), marginalization_(marginalization), multi_observation_(multi_observation),
+      min_kfs_(min_kfs), max_kfs_(max_kfs), min_covisibility_(min_covisibility), time_budget_(time_budget), num_kfs_(max_kfs), culling_(culling),
+      min_observations_(min_observations)
 {
     thread_ = std::thread(std::bind(&Backend::BackendLoop, this));
     thread_global_ = std::thread(std::bind(&Backend::GlobalLoop, this));
@@ -36,9 +41,56 @@ void Backend::BackendLoop()
         auto t2 = std::chrono::steady_clock::now();
         auto time_used = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
         LOG(INFO) << "Backend cost time: " << time_used.count() << " seconds.";
+        AdaptWindow(time_used.count());
     }
 }
 
+void Backend::AdaptWindow(double time_used)
+{
+    // without a budget, the window keeps max_kfs_ keyframes
+    if (time_budget_ > 0)
+    {
+        time_used_ = time_used_ ? 0.8 * time_used_ + 0.2 * time_used : time_used;
+        if (time_used_ > time_budget_ && num_kfs_ > min_kfs_)
+        {
+            num_kfs_--;
+        }
+        else if (time_used_ < 0.5 * time_budget_ && num_kfs_ < max_kfs_)
+        {
+            num_kfs_++;
+        }
+    }
+    std::unique_lock<std::mutex> lock(mutex_statistics_);
+    statistics_.num_kfs = num_kfs_;
+}
+
+double Backend::WindowStart(Frames &active_kfs)
+{
+    double end = (--active_kfs.end())->first;
+    double start = end + epsilon - window_size_;
+    if ((int)active_kfs.size() > num_kfs_)
+    {
+        start = std::max(start, std::prev(active_kfs.end(), num_kfs_)->first);
+    }
+    // beyond min_kfs_, older keyframes are kept only if they share enough landmarks with the kept ones
+    std::vector<Frame::Ptr> kept;
+    for (auto iter = active_kfs.rbegin(); iter != active_kfs.rend() && iter->first >= start; iter++)
+    {
+        if (min_covisibility_ > 0 && (int)kept.size() >= min_kfs_)
+        {
+            int covisibility = 0;
+            for (auto &frame : kept)
+            {
+                covisibility = std::max(covisibility, iter->second->GetCovisibility(frame->time));
+            }
+            if (covisibility < min_covisibility_)
+                return kept.back()->time;
+        }
+        kept.push_back(iter->second);
+    }
+    return start;
+}
+
 void Backend::GlobalLoop()
 {
     double start = 0;
@@ -93,50 +145,166 @@ void Backend::GlobalLoop()
     }
 }
 
+// visual residual generated in parallel, added to the problem later
+struct VisualResidual
+{
+    ProblemType type;
+    ceres::CostFunction *cost_function;
+    double *inv_depth;   // nullptr if pose only
+    double *para_fist_kf; // nullptr if the landmark is observed first in this keyframe
+};
+
+// all observations in the window of a landmark first observed in the window
+struct LandmarkResidual
+{
+    visual::Landmark::Ptr landmark;
+    std::vector<Frame::Ptr> frames;
+    std::vector<visual::Feature::Ptr> features;
+    std::vector<ProblemType> types;
+    ceres::CostFunction *cost_function;
+    ceres::LossFunction *loss_function;
+};
+
 double Backend::BuildProblem(Frames &active_kfs, adapt::Problem &problem)
 {
-    ceres::LossFunction *loss_function = new ceres::HuberLoss(1.0);
-    ceres::LocalParameterization *local_parameterization = new ceres::ProductParameterization(
+    ceres::LossFunction *loss_function = problem.New<ceres::HuberLoss>(1.0);
+    ceres::LocalParameterization *local_parameterization = problem.New<ceres::ProductParameterization>(
         new ceres::EigenQuaternionParameterization(),
         new ceres::IdentityParameterization(3));
 
     double start_time = active_kfs.begin()->first;
     double global_end = start_time;
-    Frame::Ptr last_frame;
-    double *para_last_kf;
+
+    // generate visual residuals of keyframes in parallel
+    std::vector<Frame::Ptr> frames;
     for (auto &pair_kf : active_kfs)
     {
-        auto frame = pair_kf.second;
-        double *para_kf = frame->pose.data();
-        problem.AddParameterBlock(para_kf, SE3d::num_parameters, local_parameterization);
+        frames.push_back(pair_kf.second);
+    }
+    std::vector<std::vector<VisualResidual>> batches(frames.size());
+    std::vector<std::vector<visual::Feature::Ptr>> multi_observations(frames.size());
+    std::vector<double> global_ends(frames.size(), start_time);
+    parallel_for(frames.size(), [&](int i) {
+        auto frame = frames[i];
+        auto &batch = batches[i];
+        batch.reserve(frame->features_left.size());
         for (auto &pair_feature : frame->features_left)
         {
             auto feature = pair_feature.second;
             auto landmark = feature->landmark.lock();
             auto first_frame = landmark->FirstFrame().lock();
-            auto type = Camera::Get()->Far(landmark->ToWorld(), frame->pose) ? ProblemType::WeakError : ProblemType::VisualError;
-            ceres::CostFunction *cost_function;
             if (first_frame == frame)
             {
-                double *para_inv_depth = &landmark->inv_depth;
-                problem.AddParameterBlock(para_inv_depth, 1);
-                cost_function = TwoCameraReprojectionError::Create(cv2eigen(feature->keypoint.pt), cv2eigen(landmark->first_observation->keypoint.pt), Camera::Get(0), Camera::Get(1), 5 * frame->weights.visual);
-                problem.AddResidualBlock(ProblemType::Other, cost_function, loss_function, para_inv_depth);
+                auto cost_function = problem.New<TwoCameraReprojectionCost>(cv2eigen(feature->keypoint.pt), cv2eigen(landmark->first_observation->keypoint.pt), Camera::Get(0), Camera::Get(1), 5 * frame->weights.visual);
+                batch.push_back({ProblemType::Other, cost_function, &landmark->inv_depth, nullptr});
+                continue;
+            }
+            Vector3d pw = landmark->ToWorld();
+            auto type = Camera::Get()->Far(pw, frame->pose) ? ProblemType::WeakError : ProblemType::VisualError;
+            if (first_frame->time < start_time)
+            {
+                global_ends[i] = std::min(first_frame->last_keyframe ? first_frame->last_keyframe->time : 0, global_ends[i]);
+                auto cost_function = problem.New<PoseOnlyReprojectionCost>(cv2eigen(feature->keypoint.pt), pw, Camera::Get(), frame->weights.visual);
+                batch.push_back({type, cost_function, nullptr, nullptr});
             }
-            else if (first_frame->time < start_time)
+            else if (multi_observation_)
             {
-                global_end = std::min(first_frame->last_keyframe ? first_frame->last_keyframe->time : 0, global_end);
-                cost_function = PoseOnlyReprojectionError::Create(cv2eigen(feature->keypoint.pt), landmark->ToWorld(), Camera::Get(), frame->weights.visual);
-                problem.AddResidualBlock(type, cost_function, loss_function, para_kf);
+                multi_observations[i].push_back(feature);
             }
             else
             {
-                double *para_fist_kf = first_frame->pose.data();
-                double *para_inv_depth = &landmark->inv_depth;
-                problem.AddParameterBlock(para_inv_depth, 1);
                 // first ob is on right camera; current ob is on left camera;
-                cost_function = TwoFrameReprojectionError::Create(cv2eigen(landmark->first_observation->keypoint.pt), cv2eigen(feature->keypoint.pt), Camera::Get(0), Camera::Get(1), frame->weights.visual);
-                problem.AddResidualBlock(type, cost_function, loss_function, para_inv_depth, para_fist_kf, para_kf);
+                auto cost_function = problem.New<TwoFrameReprojectionCost>(cv2eigen(landmark->first_observation->keypoint.pt), cv2eigen(feature->keypoint.pt), Camera::Get(0), Camera::Get(1), frame->weights.visual);
+                batch.push_back({type, cost_function, &landmark->inv_depth, first_frame->pose.data()});
+            }
+        }
+    });
+
+    // group the observations by landmark, one residual block for every landmark
+    std::vector<LandmarkResidual> landmark_residuals;
+    if (multi_observation_)
+    {
+        std::unordered_map<unsigned long, int> index;
+        for (int i = 0; i < frames.size(); i++)
+        {
+            for (auto &feature : multi_observations[i])
+            {
+                auto landmark = feature->landmark.lock();
+                auto iter = index.find(landmark->id);
+                if (iter == index.end())
+                {
+                    iter = index.insert(std::make_pair(landmark->id, landmark_residuals.size())).first;
+                    landmark_residuals.push_back(LandmarkResidual());
+                    landmark_residuals.back().landmark = landmark;
+                }
+                landmark_residuals[iter->second].frames.push_back(frames[i]);
+                landmark_residuals[iter->second].features.push_back(feature);
+            }
+        }
+        parallel_for(landmark_residuals.size(), [&](int i) {
+            auto &residual = landmark_residuals[i];
+            int n = residual.features.size();
+            Vector3d pw = residual.landmark->ToWorld();
+            Matrix2Xd obs(2, n);
+            VectorXd weights(n);
+            for (int j = 0; j < n; j++)
+            {
+                obs.col(j) = cv2eigen(residual.features[j]->keypoint.pt);
+                weights[j] = residual.frames[j]->weights.visual;
+                residual.types.push_back(Camera::Get()->Far(pw, residual.frames[j]->pose) ? ProblemType::WeakError : ProblemType::VisualError);
+            }
+            Vector2d first_ob = cv2eigen(residual.landmark->first_observation->keypoint.pt);
+            if (n == 1)
+            {
+                residual.cost_function = problem.New<TwoFrameReprojectionCost>(first_ob, obs.col(0), Camera::Get(0), Camera::Get(1), weights[0]);
+                residual.loss_function = loss_function;
+            }
+            else
+            {
+                // the loss is on the whole landmark, scaled to keep the threshold of a single observation
+                residual.cost_function = problem.New<MultiFrameReprojectionCost>(first_ob, obs, weights, Camera::Get(0), Camera::Get(1));
+                residual.loss_function = problem.New<ceres::HuberLoss>(std::sqrt(n));
+            }
+        });
+    }
+
+    // add to the problem in order, keyframes observed by a landmark are added before it
+    for (auto &frame : frames)
+    {
+        problem.AddParameterBlock(frame->pose.data(), SE3d::num_parameters, local_parameterization);
+    }
+    for (auto &residual : landmark_residuals)
+    {
+        std::vector<double *> paras = {&residual.landmark->inv_depth, residual.landmark->FirstFrame().lock()->pose.data()};
+        for (auto &frame : residual.frames)
+        {
+            paras.push_back(frame->pose.data());
+        }
+        problem.AddParameterBlock(paras[0], 1);
+        problem.AddResidualBlock(residual.types, residual.cost_function, residual.loss_function, paras);
+    }
+    Frame::Ptr last_frame;
+    double *para_last_kf;
+    for (int i = 0; i < frames.size(); i++)
+    {
+        auto frame = frames[i];
+        double *para_kf = frame->pose.data();
+        global_end = std::min(global_ends[i], global_end);
+        for (auto &residual : batches[i])
+        {
+            if (!residual.inv_depth)
+            {
+                problem.AddResidualBlock(residual.type, residual.cost_function, loss_function, para_kf);
+                continue;
+            }
+            problem.AddParameterBlock(residual.inv_depth, 1);
+            if (!residual.para_fist_kf)
+            {
+                problem.AddResidualBlock(residual.type, residual.cost_function, loss_function, residual.inv_depth);
+            }
+            else
+            {
+                problem.AddResidualBlock(residual.type, residual.cost_function, loss_function, residual.inv_depth, residual.para_fist_kf, para_kf);
             }
         }
 
@@ -155,12 +323,31 @@ double Backend::BuildProblem(Frames &active_kfs, adapt::Problem &problem)
                     auto para_v_last = last_frame->Vw.data();
                     auto para_bg_last = last_frame->bias.linearized_bg.data();
                     auto para_ba_last = last_frame->bias.linearized_ba.data();
-                    ceres::CostFunction *cost_function = ImuError::Create(frame->preintegration);
+                    ceres::CostFunction *cost_function = problem.New<ImuError>(frame->preintegration);
                     problem.AddResidualBlock(ProblemType::ImuError, cost_function, NULL, para_last_kf, para_v_last, para_ba_last, para_bg_last, para_kf, para_v, para_ba, para_bg);
                 }
             }
         }
 
+        // prior of marginalized keyframes
+        if (prior_ && frame->time == start_time && frame->time == prior_->time)
+        {
+            // the keyframe may be moved by loop, navsat or mapping since the last solve
+            SE3d transform = frame->pose * prior_->last_pose.inverse();
+            prior_->pose = transform * prior_->pose;
+            prior_->v = transform.so3() * prior_->v;
+            prior_->last_pose = frame->pose;
+            ceres::CostFunction *cost_function = problem.New<PriorError>(prior_);
+            if (prior_->Size() == 15)
+            {
+                problem.AddResidualBlock(ProblemType::Other, cost_function, NULL, para_kf, frame->Vw.data(), frame->bias.linearized_ba.data(), frame->bias.linearized_bg.data());
+            }
+            else
+            {
+                problem.AddResidualBlock(ProblemType::Other, cost_function, NULL, para_kf);
+            }
+        }
+
         // check if weak constraint
         auto num_types = problem.GetTypes(para_kf);
         if (!num_types[ProblemType::ImuError] && num_types[ProblemType::VisualError] < 20)
@@ -182,11 +369,45 @@ double Backend::BuildProblem(Frames &active_kfs, adapt::Problem &problem)
     return global_end != start_time ? global_end : global_end_;
 }
 
-double compute_reprojection_error(Vector2d ob, Vector3d pw, SE3d pose, Camera::Ptr camera)
+void Backend::SetOrdering(adapt::Problem &problem, ceres::Solver::Options &options)
+{
+    // eliminate inverse depths first, then velocities and biases, poses are left in the reduced camera system
+    std::vector<double *> paras;
+    problem.GetParameterBlocks(&paras);
+    ceres::ParameterBlockOrdering *ordering = new ceres::ParameterBlockOrdering;
+    int num_landmarks = 0;
+    for (auto para : paras)
+    {
+        int size = problem.ParameterBlockSize(para);
+        if (size == 1)
+        {
+            ordering->AddElementToGroup(para, 0);
+            num_landmarks++;
+        }
+        else if (size == SE3d::num_parameters)
+        {
+            ordering->AddElementToGroup(para, 2);
+        }
+        else
+        {
+            ordering->AddElementToGroup(para, 1);
+        }
+    }
+    if (num_landmarks)
+    {
+        options.linear_solver_ordering.reset(ordering);
+    }
+    else
+    {
+        // the first group must be an independent set, leave it to ceres
+        delete ordering;
+    }
+}
+
+Backend::Statistics Backend::GetStatistics()
 {
-    Vector2d error(0, 0);
-    PoseOnlyReprojectionError(ob, pw, camera, 1)(pose.data(), error.data());
-    return error.norm();
+    std::unique_lock<std::mutex> lock(mutex_statistics_);
+    return statistics_;
 }
 
 void Backend::Optimize()
@@ -197,6 +418,7 @@ void Backend::Optimize()
 
     double start = active_kfs.begin()->first;
     double end = (--active_kfs.end())->first;
+    active_end = end;
     SE3d old_pose = (--active_kfs.end())->second->pose;
     SE3d start_pose = active_kfs.begin()->second->pose;
 
@@ -206,90 +428,397 @@ void Backend::Optimize()
     ceres::Solver::Options options;
     options.linear_solver_type = ceres::SPARSE_SCHUR;
     options.max_solver_time_in_seconds = (end - start) / active_kfs.size();
+    if (time_budget_ > 0)
+    {
+        options.max_solver_time_in_seconds = std::min(options.max_solver_time_in_seconds, time_budget_);
+    }
     options.num_threads = num_threads;
+    SetOrdering(problem, options);
+    // warm start from the last solve if the window has the same structure
+    std::pair<int, bool> structure(problem.num_frames, Imu::Num() && Imu::Get()->initialized);
+    if (structure == last_structure_ && last_radius_ > 0)
+    {
+        options.initial_trust_region_radius = std::min(last_radius_, options.max_trust_region_radius);
+    }
     ceres::Solver::Summary summary;
     adapt::Solve(options, &problem, &summary);
+    last_structure_ = structure;
+    last_radius_ = summary.iterations.empty() ? 0 : summary.iterations.back().trust_region_radius;
+    {
+        std::unique_lock<std::mutex> lock(mutex_statistics_);
+        statistics_.num_iterations = summary.iterations.size();
+        statistics_.num_residual_blocks = summary.num_residual_blocks;
+        statistics_.linear_solver_time = summary.linear_solver_time_in_seconds;
+        statistics_.residual_evaluation_time = summary.residual_evaluation_time_in_seconds;
+        statistics_.jacobian_evaluation_time = summary.jacobian_evaluation_time_in_seconds;
+        statistics_.total_time = summary.total_time_in_seconds;
+    }
+    LOG(INFO) << "Backend solve: " << summary.iterations.size() << " iterations, "
+              << summary.num_residual_blocks << " residual blocks, linear solver "
+              << summary.linear_solver_time_in_seconds << "s, residuals "
+              << summary.residual_evaluation_time_in_seconds << "s, jacobians "
+              << summary.jacobian_evaluation_time_in_seconds << "s.";
     if (Imu::Num() && Imu::Get()->initialized)
     {
         imu::RecoverBias(active_kfs);
     }
+    double next_start = WindowStart(active_kfs);
+    if (marginalization_)
+    {
+        Marginalize(active_kfs, next_start);
+    }
+    if (culling_)
+    {
+        CullKeyFrames(active_kfs, next_start);
+    }
 
     // update frontend
     SE3d new_pose = (--active_kfs.end())->second->pose;
     SE3d transform = new_pose * old_pose.inverse();
     UpdateFrontend(transform, end + epsilon);
-    finished = end + epsilon - window_size_;
+    finished = next_start;
 
     if (Lidar::Num() && mapping_)
     {
-        Frames mapping_kfs = Map::Instance().GetKeyFrames(start, end - window_size_);
-        mapping_->Optimize(mapping_kfs);
+        Frames mapping_kfs = Map::Instance().GetKeyFrames(start, next_start - epsilon);
+        mapping_->AddKeyFrames(mapping_kfs);
     }
 
     // reject outliers and clean the map
+    std::vector<Frame::Ptr> frames;
     for (auto &pair_kf : active_kfs)
     {
-        auto frame = pair_kf.second;
-        auto features_left = frame->features_left;
-        for (auto &pair_feature : features_left)
+        frames.push_back(pair_kf.second);
+    }
+    std::vector<visual::Features> outliers(frames.size());
+    parallel_for(frames.size(), [&](int i) {
+        auto frame = frames[i];
+        visual::Features features;
+        for (auto &pair_feature : frame->features_left)
+        {
+            if (pair_feature.second->landmark.lock()->FirstFrame().lock() != frame)
+            {
+                features.insert(pair_feature);
+            }
+        }
+        int n = features.size(), j = 0;
+        Matrix3Xd pws(3, n);
+        Matrix2Xd obs(2, n), pixels;
+        VectorXd depths;
+        Array<bool, Dynamic, 1> far;
+        for (auto &pair_feature : features)
+        {
+            pws.col(j) = pair_feature.second->landmark.lock()->ToWorld();
+            obs.col(j++) = cv2eigen(pair_feature.second->keypoint.pt);
+        }
+        Camera::Get()->World2Pixel(pws, frame->pose, pixels, depths, far);
+        VectorXd errors = (pixels - obs).colwise().norm();
+        j = 0;
+        for (auto &pair_feature : features)
+        {
+            if (errors[j++] > 10)
+            {
+                outliers[i].insert(pair_feature);
+            }
+        }
+    });
+    for (int i = 0; i < frames.size(); i++)
+    {
+        for (auto &pair_feature : outliers[i])
+        {
+            pair_feature.second->landmark.lock()->RemoveObservation(pair_feature.second);
+            frames[i]->RemoveFeature(pair_feature.second);
+        }
+    }
+    PruneLandmarks(active_kfs, next_start);
+
+    std::unique_lock<std::mutex> lock(mutex_statistics_);
+    statistics_.num_landmarks = Map::Instance().landmarks.size();
+    statistics_.landmark_memory = Map::Instance().LandmarkMemory();
+}
+
+void Backend::PruneLandmarks(Frames &active_kfs, double time)
+{
+    auto frontend = frontend_.lock();
+    int num_pruned = 0;
+    for (auto iter = active_kfs.begin(); iter != active_kfs.end() && iter->first < time; iter++)
+    {
+        Frame::Ptr frame = iter->second;
+        // the landmarks of the local map may be observed again
+        if (frontend && frontend->local_map.Contains(frame->time))
+            continue;
+
+        std::vector<visual::Landmark::Ptr> weak_landmarks;
+        for (auto &pair_feature : frame->features_left)
+        {
+            auto landmark = pair_feature.second->landmark.lock();
+            if (landmark->FirstFrame().lock() != frame ||
+                (int)landmark->observations.size() >= min_observations_)
+                continue;
+            double last_time = landmark->LastFrame().lock()->time;
+            if (last_time < time && !(frontend && frontend->local_map.Contains(last_time)))
+            {
+                weak_landmarks.push_back(landmark);
+            }
+        }
+        for (auto &landmark : weak_landmarks)
+        {
+            Map::Instance().RemoveLandmark(landmark);
+        }
+        num_pruned += weak_landmarks.size();
+    }
+    if (num_pruned)
+    {
+        LOG(INFO) << "Prune " << num_pruned << " landmarks, " << Map::Instance().landmarks.size() << " left.";
+    }
+}
+
+bool Backend::IsRedundant(Frame::Ptr frame, Frame::Ptr next_frame)
+{
+    // keep the keyframes used by other modules
+    Frame::Ptr last_frame = frame->last_keyframe;
+    if (!last_frame || next_frame->last_keyframe != frame ||
+        next_frame->time - last_frame->time > max_culled_interval_ ||
+        frame->feature_lidar || frame->feature_navsat || frame->loop_closure ||
+        (Imu::Num() && (!frame->preintegration || !next_frame->preintegration)) ||
+        PoseGraph::Instance().IsAnchor(frame->time))
+        return false;
+    auto frontend = frontend_.lock();
+    if (frontend && frontend->local_map.Contains(frame->time))
+        return false;
+
+    // at least 90% landmarks are observed by other 3 keyframes,
+    // and the landmarks first observed in it are not observed by others
+    int num_landmarks = 0, num_redundant = 0;
+    for (auto &pair_feature : frame->features_left)
+    {
+        auto landmark = pair_feature.second->landmark.lock();
+        if (landmark->FirstFrame().lock() == frame)
+        {
+            if (landmark->observations.size() > 1)
+                return false;
+            continue;
+        }
+        num_landmarks++;
+        if (landmark->observations.size() > 3)
+        {
+            num_redundant++;
+        }
+    }
+    return num_landmarks && num_redundant >= 0.9 * num_landmarks;
+}
+
+void Backend::CullKeyFrames(Frames &active_kfs, double time)
+{
+    for (auto iter = active_kfs.begin(); iter != active_kfs.end() && iter->first < time;)
+    {
+        Frame::Ptr frame = iter->second;
+        Frames next_kfs = Map::Instance().GetKeyFrames(frame->time, 0, 1);
+        if (next_kfs.empty() || !IsRedundant(frame, next_kfs.begin()->second))
+        {
+            iter++;
+            continue;
+        }
+
+        Frame::Ptr next_frame = next_kfs.begin()->second;
+        visual::Features features = frame->features_left;
+        for (auto &pair_feature : features)
         {
             auto feature = pair_feature.second;
             auto landmark = feature->landmark.lock();
-            auto first_frame = landmark->FirstFrame().lock();
-            if (frame != first_frame && compute_reprojection_error(cv2eigen(feature->keypoint.pt), landmark->ToWorld(), frame->pose, Camera::Get()) > 10)
+            if (landmark->FirstFrame().lock() == frame)
+            {
+                Map::Instance().RemoveLandmark(landmark);
+            }
+            else
             {
                 landmark->RemoveObservation(feature);
                 frame->RemoveFeature(feature);
             }
         }
+        // the next keyframe is integrated from the last one
+        if (frame->preintegration && next_frame->preintegration)
+        {
+            next_frame->preintegration = imu::Preintegration::Merge(frame->preintegration, next_frame->preintegration, frame->last_keyframe->bias);
+        }
+        next_frame->last_keyframe = frame->last_keyframe;
+        Map::Instance().RemoveKeyFrame(frame);
+        LOG(INFO) << "Cull keyframe " << frame->id;
+        iter = active_kfs.erase(iter);
     }
 }
 
-void Backend::UpdateFrontend(SE3d transform, double time)
+void Backend::Marginalize(Frames &active_kfs, double time)
 {
-    // perpare for active kfs
-    std::unique_lock<std::mutex> lock(frontend_.lock()->mutex);
-    Frame::Ptr last_frame = frontend_.lock()->last_frame;
-    Frames active_kfs = Map::Instance().GetKeyFrames(time);
-    if (active_kfs.find(last_frame->time) == active_kfs.end())
+    // keyframes before time leave the window, their information is left on the first kept keyframe
+    auto iter = active_kfs.lower_bound(time);
+    if (iter == active_kfs.end())
+    {
+        prior_.reset();
+        return;
+    }
+    Frame::Ptr kept_frame = iter->second;
+    if (iter == active_kfs.begin())
     {
-        active_kfs[last_frame->time] = last_frame;
+        if (prior_ && prior_->time == kept_frame->time)
+        {
+            prior_->last_pose = kept_frame->pose;
+        }
+        return;
     }
-    PoseGraph::Instance().ForwardUpdate(transform, active_kfs);
 
     adapt::Problem problem;
-    BuildProblem(active_kfs, problem);
-    ceres::Solver::Options options;
-    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
-    options.max_num_iterations = 1;
-    options.num_threads = num_threads;
-    ceres::Solver::Summary summary;
-    adapt::Solve(options, &problem, &summary);
-    if (Imu::Num() && Imu::Get()->initialized)
+    ceres::LossFunction *loss_function = problem.New<ceres::HuberLoss>(1.0);
+    ceres::LocalParameterization *local_parameterization = problem.New<ceres::ProductParameterization>(
+        new ceres::EigenQuaternionParameterization(),
+        new ceres::IdentityParameterization(3));
+
+    // landmarks of older keyframes are fixed, the same as BuildProblem
+    double start_time = active_kfs.begin()->first;
+    bool use_imu = Imu::Num() && Imu::Get()->initialized;
+    Frame::Ptr last_frame;
+    double *para_last_kf;
+    for (auto i = active_kfs.begin(); i != std::next(iter); i++)
     {
-        imu::RecoverBias(active_kfs);
+        auto frame = i->second;
+        double *para_kf = frame->pose.data();
+        problem.AddParameterBlock(para_kf, SE3d::num_parameters, local_parameterization);
+        if (frame != kept_frame)
+        {
+            for (auto &pair_feature : frame->features_left)
+            {
+                auto feature = pair_feature.second;
+                auto landmark = feature->landmark.lock();
+                if (landmark->FirstFrame().lock()->time < start_time)
+                {
+                    ceres::CostFunction *cost_function = problem.New<PoseOnlyReprojectionCost>(cv2eigen(feature->keypoint.pt), landmark->ToWorld(), Camera::Get(), frame->weights.visual);
+                    problem.AddResidualBlock(ProblemType::VisualError, cost_function, loss_function, para_kf);
+                }
+            }
+        }
+        if (use_imu && frame->good_imu && last_frame && last_frame->good_imu)
+        {
+            ceres::CostFunction *cost_function = problem.New<ImuError>(frame->preintegration);
+            problem.AddResidualBlock(ProblemType::ImuError, cost_function, NULL, para_last_kf, last_frame->Vw.data(), last_frame->bias.linearized_ba.data(), last_frame->bias.linearized_bg.data(),
+                                     para_kf, frame->Vw.data(), frame->bias.linearized_ba.data(), frame->bias.linearized_bg.data());
+        }
+        if (prior_ && frame->time == prior_->time && i == active_kfs.begin())
+        {
+            ceres::CostFunction *cost_function = problem.New<PriorError>(prior_);
+            if (prior_->Size() == 15)
+            {
+                problem.AddResidualBlock(ProblemType::Other, cost_function, NULL, para_kf, frame->Vw.data(), frame->bias.linearized_ba.data(), frame->bias.linearized_bg.data());
+            }
+            else
+            {
+                problem.AddResidualBlock(ProblemType::Other, cost_function, NULL, para_kf);
+            }
+        }
+        last_frame = frame;
+        para_last_kf = para_kf;
     }
-    // imu initialization
-    if (Imu::Num())
+
+    // order the parameters as [marginalized, kept]
+    std::vector<double *> para_kept = {kept_frame->pose.data()};
+    if (use_imu && kept_frame->good_imu)
     {
-        initializer_->Initialize(frontend_.lock()->init_time, time);
+        para_kept.push_back(kept_frame->Vw.data());
+        para_kept.push_back(kept_frame->bias.linearized_ba.data());
+        para_kept.push_back(kept_frame->bias.linearized_bg.data());
     }
-    // update imu
-    if (Imu::Num() && Imu::Get()->initialized)
+    std::vector<double *> paras, para_ordered;
+    problem.GetParameterBlocks(&paras);
+    int m = 0, n = 0;
+    for (auto para : paras)
     {
-        Frame::Ptr prior_frame = Map::Instance().GetKeyFrames(0, time, 1).begin()->second;
-        imu::RePredictVel(active_kfs, prior_frame);
-        if (active_kfs.size() == 0)
+        if (std::find(para_kept.begin(), para_kept.end(), para) == para_kept.end())
         {
-            frontend_.lock()->UpdateImu(prior_frame->bias);
+            para_ordered.push_back(para);
+            m += problem.ParameterBlockLocalSize(para);
         }
-        else
+    }
+    for (auto para : para_kept)
+    {
+        if (!problem.HasParameterBlock(para))
+        {
+            problem.AddParameterBlock(para, 3);
+        }
+        para_ordered.push_back(para);
+        n += problem.ParameterBlockLocalSize(para);
+    }
+    if (m == 0 || problem.NumResidualBlocks() == 0)
+    {
+        prior_.reset();
+        return;
+    }
+
+    // linearize at the current estimate
+    ceres::Problem::EvaluateOptions options;
+    options.parameter_blocks = para_ordered;
+    options.num_threads = num_threads;
+    std::vector<double> residuals;
+    ceres::CRSMatrix jacobian;
+    problem.Evaluate(options, NULL, &residuals, NULL, &jacobian);
+    MatrixXd J = MatrixXd::Zero(jacobian.num_rows, jacobian.num_cols);
+    for (int row = 0; row < jacobian.num_rows; row++)
+    {
+        for (int k = jacobian.rows[row]; k < jacobian.rows[row + 1]; k++)
+        {
+            J(row, jacobian.cols[k]) = jacobian.values[k];
+        }
+    }
+    VectorXd r = Eigen::Map<VectorXd>(residuals.data(), residuals.size());
+    MatrixXd H = J.transpose() * J;
+    VectorXd g = J.transpose() * r;
+
+    // schur complement
+    MatrixXd H_mm = 0.5 * (H.topLeftCorner(m, m) + H.topLeftCorner(m, m).transpose());
+    SelfAdjointEigenSolver<MatrixXd> saes_mm(H_mm);
+    VectorXd S_mm_inv = (saes_mm.eigenvalues().array() > 1e-8).select(saes_mm.eigenvalues().array().inverse(), 0);
+    MatrixXd H_km_H_mm_inv = H.bottomLeftCorner(n, m) * saes_mm.eigenvectors() * S_mm_inv.asDiagonal() * saes_mm.eigenvectors().transpose();
+    MatrixXd H_prior = H.bottomRightCorner(n, n) - H_km_H_mm_inv * H.topRightCorner(m, n);
+    VectorXd g_prior = g.tail(n) - H_km_H_mm_inv * g.head(m);
+
+    // H_prior = J^T * J, g_prior = J^T * r
+    SelfAdjointEigenSolver<MatrixXd> saes(0.5 * (H_prior + H_prior.transpose()));
+    ArrayXd S = (saes.eigenvalues().array() > 1e-8).select(saes.eigenvalues().array(), 0);
+    if ((S == 0).all())
+    {
+        prior_.reset();
+        return;
+    }
+    ArrayXd S_sqrt = S.sqrt();
+    ArrayXd S_inv_sqrt = (S > 0).select(S_sqrt.inverse(), 0);
+    Prior::Ptr prior = Prior::Ptr(new Prior);
+    prior->time = kept_frame->time;
+    prior->pose = prior->last_pose = kept_frame->pose;
+    prior->v = kept_frame->Vw;
+    prior->ba = kept_frame->bias.linearized_ba;
+    prior->bg = kept_frame->bias.linearized_bg;
+    prior->J = S_sqrt.matrix().asDiagonal() * saes.eigenvectors().transpose();
+    prior->r = S_inv_sqrt.matrix().asDiagonal() * saes.eigenvectors().transpose() * g_prior;
+    prior_ = prior;
+}
+
+void Backend::UpdateFrontend(SE3d transform, double time)
+{
+    // imu initialization
+    if (Imu::Num())
+    {
+        bool initialized = Imu::Get()->initialized;
+        initializer_->Initialize(frontend_.lock()->init_time, time);
+        if (initialized != Imu::Get()->initialized)
         {
-            frontend_.lock()->UpdateImu((--active_kfs.end())->second->bias);
+            // velocities and biases are reset
+            prior_.reset();
         }
     }
-    // update frontend landmarks and pose
-    frontend_.lock()->UpdateCache();
+    // keyframes after the window follow the last one, the frontend applies the rest at its next frame
+    Correction::Ptr correction(new Correction);
+    correction->update_imu = Imu::Num() && Imu::Get()->initialized;
+    correction->has_cache = true;
+    frontend_.lock()->local_map.ComputeCache(time, correction->positions, correction->poses);
+    PoseGraph::Instance().ForwardUpdate(transform, time, correction);
 }
 
 } // namespace lvio_fusion
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "lvio_fusion/visual/budget.h"
+
+namespace lvio_fusion
+{
+
+inline double smooth(double avg, double x, double alpha)
+{
+    return avg ? (1 - alpha) * avg + alpha * x : x;
+}
+
+void FeatureBudget::Update(double frame_time, double keyframe_time, int num_inliers, int &num_features, int &for_keyframe)
+{
+    avg_tracking_time_ = smooth(avg_tracking_time_, frame_time - keyframe_time, alpha_);
+    if (keyframe_time > 0)
+    {
+        avg_keyframe_time_ = smooth(avg_keyframe_time_, keyframe_time, alpha_);
+    }
+    avg_inliers_ = smooth(avg_inliers_, num_inliers, alpha_);
+
+    double ratio = 1;
+    if (avg_inliers_ < 2 * tracking_bad_)
+    {
+        // tracking is close to bad, we need more features whatever the cost is
+        ratio = 1.2;
+    }
+    else
+    {
+        // the slowest frame is a keyframe, it should also be under the target
+        double cost = avg_tracking_time_ + avg_keyframe_time_;
+        if (cost > frame_time_ || (cost > 0 && cost < 0.8 * frame_time_))
+        {
+            ratio = std::min(1.2, std::max(0.8, frame_time_ / cost));
+        }
+    }
+    if (ratio == 1)
+        return;
+
+    // less features cost less time in extracting, matching and tracking;
+    // lower threshold creates less keyframes.
+    num_features = std::min(max_features_, std::max(min_features_, (int)(num_features * ratio)));
+    for_keyframe = std::min(max_for_keyframe_, std::max(min_for_keyframe_, (int)(for_keyframe * ratio)));
+    for_keyframe = std::max(min_for_keyframe_, std::min(for_keyframe, num_features / 2));
+}
+
+} // namespace lvio_fusion
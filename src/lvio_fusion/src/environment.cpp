@@ -18,18 +18,18 @@ bool Environment::initialized_ = false;
 SE3d Environment::Optimize()
 {
     int num_threads = 1;
-    ceres::LocalParameterization *local_parameterization = new ceres::ProductParameterization(
-        new ceres::EigenQuaternionParameterization(),
-        new ceres::IdentityParameterization(3));
     Frame::Ptr frame = Frame::Ptr(new Frame());
     *frame = *(state_->second);
 
     // visual
     {
         adapt::Problem problem;
+        ceres::LocalParameterization *local_parameterization = problem.New<ceres::ProductParameterization>(
+            new ceres::EigenQuaternionParameterization(),
+            new ceres::IdentityParameterization(3));
         double *para = frame->pose.data();
         problem.AddParameterBlock(para, SE3d::num_parameters, local_parameterization);
-        ceres::LossFunction *loss_function = new ceres::HuberLoss(1.0);
+        ceres::LossFunction *loss_function = problem.New<ceres::HuberLoss>(1.0);
         for (auto &pair_feature : frame->features_left)
         {
             auto feature = pair_feature.second;
@@ -80,9 +80,8 @@ SE3d Environment::Optimize()
     // lidar
     if (estimator_->mapping)
     {
-        auto map_frame = Frame::Ptr(new Frame());
-        estimator_->mapping->BuildMapFrame(frame, map_frame);
-        if (map_frame->feature_lidar && frame->feature_lidar)
+        Frame::Ptr map_frame = estimator_->mapping->BuildMapFrame(frame);
+        if (map_frame && frame->feature_lidar)
         {
             double rpyxyz[6];
             se32rpyxyz(frame->pose * map_frame->pose.inverse(), rpyxyz); // relative_i_j
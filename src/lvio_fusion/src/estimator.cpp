@@ -92,14 +92,35 @@ bool Estimator::Init(int use_imu, int use_lidar, int use_navsat, int use_loop, i
         Config::Get<int>("num_features_needed_for_keyframe"),
         Config::Get<int>("remove_moving_points")));
 
+    double frame_time_budget = Config::Get<double>("frame_time_budget");
+    if (frame_time_budget > 0)
+    {
+        frontend->SetBudget(FeatureBudget::Ptr(new FeatureBudget(
+            frame_time_budget,
+            Config::Get<int>("num_features_min"),
+            Config::Get<int>("num_features_max"),
+            Config::Get<int>("num_features_needed_for_keyframe_min"),
+            Config::Get<int>("num_features_needed_for_keyframe_max"),
+            Config::Get<int>("num_features_tracking_bad"))));
+    }
+
     backend = Backend::Ptr(new Backend(
         Config::Get<double>("windows_size"),
-        use_adapt));
+        use_adapt,
+        Config::Get<int>("marginalization"),
+        Config::Get<int>("multi_observation"),
+        Config::Get<int>("window_min_kfs"),
+        Config::Get<int>("window_max_kfs"),
+        Config::Get<int>("window_min_covisibility"),
+        Config::Get<double>("window_time_budget"),
+        Config::Get<int>("keyframe_culling"),
+        Config::Get<int>("landmark_min_observations")));
 
     frontend->SetBackend(backend);
     backend->SetFrontend(frontend);
 
     PoseGraph::Instance().SetFrontend(frontend);
+    PoseGraph::Instance().SetBackend(backend);
 
     if (use_loop)
     {
@@ -109,6 +130,20 @@ bool Estimator::Init(int use_imu, int use_lidar, int use_navsat, int use_loop, i
         relocator->SetBackend(backend);
     }
 
+    std::string archive_path = Config::Get<std::string>("archive_path");
+    if (!archive_path.empty())
+    {
+        archive = Archive::Ptr(new Archive(
+            archive_path,
+            Config::Get<double>("archive_time_horizon"),
+            Config::Get<double>("archive_distance_horizon")));
+        archive->SetBackend(backend);
+        if (relocator)
+        {
+            relocator->SetArchive(archive);
+        }
+    }
+
     if (use_navsat)
     {
         Navsat::Create(Config::Get<double>("accuracy"),
@@ -125,7 +160,12 @@ bool Estimator::Init(int use_imu, int use_lidar, int use_navsat, int use_loop, i
         double acc_w = Config::Get<double>("acc_w");
         double gyr_w = Config::Get<double>("gyr_w");
         double g_norm = Config::Get<double>("g_norm");
-        Imu::Create(SE3d(), acc_n, acc_w, gyr_n, gyr_w, g_norm);
+        double repropagate_ba = Config::Get<double>("repropagate_ba");
+        double repropagate_bg = Config::Get<double>("repropagate_bg");
+        Imu::Create(SE3d(), acc_n, acc_w, gyr_n, gyr_w, g_norm, repropagate_ba, repropagate_bg);
+
+        propagator = imu::Propagator::Ptr(new imu::Propagator);
+        frontend->SetPropagator(propagator);
     }
 
     if (use_lidar)
@@ -154,6 +194,7 @@ bool Estimator::Init(int use_imu, int use_lidar, int use_navsat, int use_loop, i
 
         mapping = Mapping::Ptr(new Mapping);
         mapping->SetFeatureAssociation(association);
+        mapping->SetBackend(backend);
 
         backend->SetMapping(mapping);
 
@@ -161,6 +202,10 @@ bool Estimator::Init(int use_imu, int use_lidar, int use_navsat, int use_loop, i
         {
             relocator->SetMapping(mapping);
         }
+        if (archive)
+        {
+            archive->SetMapping(mapping);
+        }
     }
     return true;
 }
@@ -198,6 +243,15 @@ void Estimator::InputPointCloud(double time, Point3Cloud::Ptr point_cloud)
 void Estimator::InputImu(double time, Vector3d acc, Vector3d gyr)
 {
     frontend->AddImu(time, acc, gyr);
+    if (propagator)
+    {
+        propagator->Propagate(time, acc, gyr);
+    }
+}
+
+bool Estimator::GetLatestState(imu::State &state)
+{
+    return propagator && propagator->Get(state);
 }
 
 void Estimator::InputNavSat(double time, double x, double y, double z, Vector3d cov)
@@ -31,18 +31,7 @@ Extractor::Extractor(int nfeatures, float scaleFactor, int nlevels, int iniThFAS
 
     image_pyramid_.resize(num_levels);
 
-    num_desired_features_.resize(num_levels);
-    float inv_factor = 1.0f / scale_factor;
-    float num_desired_features_scale = num_features * (1 - inv_factor) / (1 - (float)pow((double)inv_factor, (double)num_levels));
-
-    int sum = 0;
-    for (int i = 0; i < num_levels - 1; i++)
-    {
-        num_desired_features_[i] = cvRound(num_desired_features_scale);
-        sum += num_desired_features_[i];
-        num_desired_features_scale *= inv_factor;
-    }
-    num_desired_features_[num_levels - 1] = std::max(num_features - sum, 0);
+    SetNumFeatures(num_features);
 
     // This is for orientation
     // pre-compute the end of a row in a circular patch
@@ -63,6 +52,23 @@ Extractor::Extractor(int nfeatures, float scaleFactor, int nlevels, int iniThFAS
     }
 }
 
+void Extractor::SetNumFeatures(int nfeatures)
+{
+    num_features = nfeatures;
+    num_desired_features_.resize(num_levels);
+    float inv_factor = 1.0f / scale_factor;
+    float num_desired_features_scale = num_features * (1 - inv_factor) / (1 - (float)pow((double)inv_factor, (double)num_levels));
+
+    int sum = 0;
+    for (int i = 0; i < num_levels - 1; i++)
+    {
+        num_desired_features_[i] = cvRound(num_desired_features_scale);
+        sum += num_desired_features_[i];
+        num_desired_features_scale *= inv_factor;
+    }
+    num_desired_features_[num_levels - 1] = std::max(num_features - sum, 0);
+}
+
 inline float Extractor::ICAngle(const Mat &image, Point2f pt)
 {
     int m_01 = 0, m_10 = 0;
@@ -7,6 +7,7 @@ namespace lvio_fusion
 {
 
 unsigned long Frame::current_frame_id = 0;
+static std::mutex mutex_covisibility;
 
 Frame::Frame()
 {
@@ -73,6 +74,58 @@ Observation Frame::GetObservation()
     return obs.reshape(1, 1);
 }
 
+int Frame::GetCovisibility(double time)
+{
+    std::unique_lock<std::mutex> lock(mutex_covisibility);
+    auto iter = covisibility_.find(time);
+    return iter != covisibility_.end() ? iter->second : 0;
+}
+
+std::map<double, int> Frame::GetCovisibility()
+{
+    std::unique_lock<std::mutex> lock(mutex_covisibility);
+    return covisibility_;
+}
+
+inline void update_covisibility(std::map<double, int> &covisibility, double time, int n)
+{
+    int &num = covisibility[time];
+    num += n;
+    if (num <= 0)
+    {
+        covisibility.erase(time);
+    }
+}
+
+void Frame::UpdateCovisibility(Frame::Ptr frame, const std::vector<Frame::Ptr> &others, int n)
+{
+    if (!frame)
+        return;
+    std::unique_lock<std::mutex> lock(mutex_covisibility);
+    for (auto &other : others)
+    {
+        if (!other || other == frame)
+            continue;
+        update_covisibility(frame->covisibility_, other->time, n);
+        update_covisibility(other->covisibility_, frame->time, n);
+    }
+}
+
+void Frame::UpdateCovisibility(const std::vector<Frame::Ptr> &frames, int n)
+{
+    std::unique_lock<std::mutex> lock(mutex_covisibility);
+    for (auto i = frames.begin(); i != frames.end(); i++)
+    {
+        for (auto j = std::next(i); j != frames.end(); j++)
+        {
+            if (!*i || !*j || *i == *j)
+                continue;
+            update_covisibility((*i)->covisibility_, (*j)->time, n);
+            update_covisibility((*j)->covisibility_, (*i)->time, n);
+        }
+    }
+}
+
 void Frame::SetVelocity(const Vector3d &_Vw)
 {
     Vw = _Vw;
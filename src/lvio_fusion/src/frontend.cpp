@@ -1,11 +1,14 @@
 #include "lvio_fusion/frontend.h"
 #include "lvio_fusion/backend.h"
+#include "lvio_fusion/imu/tools.h"
+#include "lvio_fusion/loop/pose_graph.h"
 #include "lvio_fusion/map.h"
 #include "lvio_fusion/navsat/navsat.h"
 #include "lvio_fusion/utility.h"
 #include "lvio_fusion/visual/camera.h"
 #include "lvio_fusion/visual/feature.h"
 #include "lvio_fusion/visual/landmark.h"
+#include "lvio_fusion/visual/pose_solver.h"
 
 namespace lvio_fusion
 {
@@ -19,7 +22,11 @@ cv::Mat img_track;
 bool Frontend::AddFrame(Frame::Ptr frame)
 {
     std::unique_lock<std::mutex> lock(mutex);
+    auto t1 = std::chrono::steady_clock::now();
+    ApplyCorrections();
     current_frame = frame;
+    num_inliers_ = 0;
+    keyframe_time_ = 0;
     cv::cvtColor(current_frame->image_left, img_track, cv::COLOR_GRAY2RGB);
     switch (status)
     {
@@ -33,10 +40,22 @@ bool Frontend::AddFrame(Frame::Ptr frame)
         Track();
         break;
     }
+    auto t2 = std::chrono::steady_clock::now();
+    if (budget_ && status == FrontendStatus::TRACKING)
+    {
+        auto time_used = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
+        int num_features = local_map.NumFeatures();
+        budget_->Update(time_used.count(), keyframe_time_, num_inliers_, num_features, num_features_needed_for_keyframe_);
+        local_map.SetNumFeatures(num_features);
+    }
     cv::imshow("tracking", img_track);
     cv::waitKey(1);
     last_frame = current_frame;
     last_frame_pose_cache_ = last_frame->pose;
+    if (propagator_ && status == FrontendStatus::TRACKING && Imu::Get()->initialized)
+    {
+        propagator_->Reset(last_frame->time, last_frame->pose, last_frame->Vw, last_frame->bias);
+    }
     return true;
 }
 
@@ -112,6 +131,7 @@ bool Frontend::Track()
 {
     SE3d init_pose = current_frame->pose;
     int num_inliers = TrackLastFrame();
+    num_inliers_ = num_inliers;
 
     if (num_inliers)
     {
@@ -159,32 +179,41 @@ int Frontend::TrackLastFrame()
     std::vector<uchar> status;
     // use LK flow to estimate points in the last image
     kps_last.reserve(last_frame->features_left.size());
-    kps_perdict.reserve(last_frame->features_left.size());
+    landmarks.reserve(last_frame->features_left.size());
     for (auto &pair : last_frame->features_left)
     {
-        // use project point
         auto feature = pair.second;
-        auto landmark = feature->landmark.lock();
-        auto px = Camera::Get()->World2Pixel(local_map.position_cache[landmark->id], current_frame->pose);
         kps_last.push_back(feature->keypoint.pt);
-        kps_perdict.push_back(cv::Point2f(px[0], px[1]));
-        landmarks.push_back(landmark);
+        landmarks.push_back(feature->landmark.lock());
     }
     // if last frame is a key frame, use new landmarks
     if (last_frame == last_keyframe)
     {
         auto features = local_map.GetFeatures(last_frame->time);
         kps_last.reserve(kps_last.size() + features.size());
-        kps_perdict.reserve(kps_perdict.size() + features.size());
+        landmarks.reserve(landmarks.size() + features.size());
         for (auto &feature : features)
         {
-            auto landmark = feature->landmark.lock();
-            auto px = Camera::Get()->World2Pixel(local_map.position_cache[landmark->id], current_frame->pose);
             kps_last.push_back(feature->keypoint.pt);
-            kps_perdict.push_back(cv::Point2f(px[0], px[1]));
-            landmarks.push_back(landmark);
+            landmarks.push_back(feature->landmark.lock());
         }
     }
+    // use project points, all in one pass
+    int n = landmarks.size();
+    Matrix3Xd pws(3, n);
+    Matrix2Xd pixels;
+    VectorXd depths;
+    Array<bool, Dynamic, 1> far;
+    for (int i = 0; i < n; i++)
+    {
+        pws.col(i) = local_map.position_cache[landmarks[i]->id];
+    }
+    Camera::Get()->World2Pixel(pws, current_frame->pose, pixels, depths, far);
+    kps_perdict.reserve(n);
+    for (int i = 0; i < n; i++)
+    {
+        kps_perdict.push_back(cv::Point2f(pixels(0, i), pixels(1, i)));
+    }
     kps_current = kps_perdict;
     optical_flow(last_frame->image_left, current_frame->image_left, kps_last, kps_current, status);
     // Solve PnP
@@ -210,19 +239,17 @@ int Frontend::TrackLastFrame()
         if (status[i])
         {
             deviations[i] -= avg_d;
-            if (Camera::Get()->Far(local_map.position_cache[landmarks[i]->id], current_frame->pose))
+            if (far[i])
             {
                 map_far.push_back(i);
                 points_2d_far.push_back(kps_current[i]);
-                Vector3d pw = local_map.position_cache[landmarks[i]->id];
-                points_3d_far.push_back(cv::Point3f(pw.x(), pw.y(), pw.z()));
+                points_3d_far.push_back(cv::Point3f(pws(0, i), pws(1, i), pws(2, i)));
             }
             else if (!remove_moving_points || cv_distance(deviations[i]) < 30)
             {
                 map_near.push_back(i);
                 points_2d_near.push_back(kps_current[i]);
-                Vector3d pw = local_map.position_cache[landmarks[i]->id];
-                points_3d_near.push_back(cv::Point3f(pw.x(), pw.y(), pw.z()));
+                points_3d_near.push_back(cv::Point3f(pws(0, i), pws(1, i), pws(2, i)));
             }
             else
             {
@@ -235,6 +262,17 @@ int Frontend::TrackLastFrame()
     int num_good_pts = 0;
     if ((int)(points_2d_near.size() + points_2d_far.size()) > num_features_tracking_bad_)
     {
+        // refine the predicted pose at camera rate, don't wait for backend
+        std::vector<cv::Point3f> points_3d(points_3d_near);
+        std::vector<cv::Point2f> points_2d(points_2d_near);
+        points_3d.insert(points_3d.end(), points_3d_far.begin(), points_3d_far.end());
+        points_2d.insert(points_2d.end(), points_2d_far.begin(), points_2d_far.end());
+        SE3d pose = current_frame->pose;
+        if (PoseSolver(Camera::Get()).Solve(points_3d, points_2d, pose) > num_features_tracking_bad_)
+        {
+            current_frame->pose = pose;
+        }
+
         // near
         for (auto &i : map_near)
         {
@@ -293,7 +331,10 @@ void Frontend::CreateKeyframe()
         landmark->AddObservation(feature);
     }
     // detect new features, track in right image and triangulate map points
+    auto t1 = std::chrono::steady_clock::now();
     local_map.AddKeyFrame(current_frame);
+    auto t2 = std::chrono::steady_clock::now();
+    keyframe_time_ = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1).count();
     // insert!
     Map::Instance().InsertKeyFrame(current_frame);
     last_keyframe = current_frame;
@@ -303,9 +344,68 @@ void Frontend::CreateKeyframe()
     backend_.lock()->UpdateMap();
 }
 
-void Frontend::UpdateCache()
+void Frontend::PostCorrection(Correction::Ptr correction)
+{
+    std::unique_lock<std::mutex> lock(mutex_corrections_);
+    corrections_.push_back(correction);
+}
+
+void Frontend::ApplyCorrections()
 {
-    local_map.UpdateCache();
+    std::vector<Correction::Ptr> corrections;
+    {
+        std::unique_lock<std::mutex> lock(mutex_corrections_);
+        corrections.swap(corrections_);
+    }
+    if (corrections.empty() || !last_frame)
+        return;
+
+    // keyframes left by the publisher go into the next window of the backend
+    std::unique_lock<std::mutex> lock(backend_.lock()->mutex, std::defer_lock);
+    for (auto &correction : corrections)
+    {
+        // keyframes not moved by the publisher, and the last frame
+        Frames forward_kfs = Map::Instance().GetKeyFrames(correction->last_time + epsilon);
+        if (!forward_kfs.empty() && !lock.owns_lock())
+        {
+            lock.lock();
+        }
+        if (last_frame->time > correction->last_time)
+        {
+            forward_kfs[last_frame->time] = last_frame;
+        }
+        PoseGraph::Instance().ForwardUpdate(correction->transform, forward_kfs);
+
+        // the publisher already repredicted the keyframes it moved
+        if (correction->update_imu && Imu::Num() && Imu::Get()->initialized && !forward_kfs.empty())
+        {
+            Frames prior_kfs = Map::Instance().GetKeyFrames(0, forward_kfs.begin()->first, 1);
+            if (!prior_kfs.empty())
+            {
+                Frame::Ptr prior_frame = prior_kfs.begin()->second;
+                imu::RePredictVel(forward_kfs, prior_frame);
+                UpdateImu(last_frame->bias);
+            }
+        }
+    }
+    if (lock.owns_lock())
+    {
+        lock.unlock();
+    }
+    // the cache is valid only if no other correction is applied after it was computed
+    UpdateCache(corrections.size() == 1 ? corrections.front() : Correction::Ptr());
+}
+
+void Frontend::UpdateCache(Correction::Ptr correction)
+{
+    if (correction && correction->has_cache)
+    {
+        local_map.UpdateCache(correction->time, correction->positions, correction->poses);
+    }
+    else
+    {
+        local_map.UpdateCache();
+    }
     for (auto &pair_feature : last_frame->features_left)
     {
         auto feature = pair_feature.second;
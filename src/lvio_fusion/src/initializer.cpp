@@ -7,40 +7,79 @@
 namespace lvio_fusion
 {
 
+Initializer::Initializer()
+{
+    thread_ = std::thread(std::bind(&Initializer::InitializerLoop, this));
+}
+
+void Initializer::InitializerLoop()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [this] { return running_ != nullptr; });
+        Snapshot::Ptr snapshot = running_;
+        lock.unlock();
+
+        auto t1 = std::chrono::steady_clock::now();
+        snapshot->success = Initialize(snapshot);
+        auto t2 = std::chrono::steady_clock::now();
+        auto time_used = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
+        LOG(INFO) << "Initializer cost time: " << time_used.count() << " seconds.";
+
+        lock.lock();
+        finished_ = snapshot;
+        running_.reset();
+    }
+}
+
 void Initializer::EstimateVelAndRwg(Frames frames)
 {
-    if (!Imu::Get()->initialized)
+    Vector3d twg = Vector3d::Zero();
+    Vector3d Vw;
+    for (auto &pair : frames)
     {
-        Vector3d twg = Vector3d::Zero();
-        Vector3d Vw;
-        for (auto &pair : frames)
-        {
-            auto frame = pair.second;
-            twg += frame->last_keyframe->R() * frame->preintegration->GetUpdatedDeltaVelocity();
-            Vw = (frame->t() - frame->last_keyframe->t()) / frame->preintegration->sum_dt;
-            frame->SetVelocity(Vw);
-            frame->SetBias(Bias());
-        }
-        if (step != 4)
-        {
-            Rwg_ = get_R_from_vector(twg);
-        }
+        auto frame = pair.second;
+        twg += frame->last_keyframe->R() * frame->preintegration->GetUpdatedDeltaVelocity();
+        Vw = (frame->t() - frame->last_keyframe->t()) / frame->preintegration->sum_dt;
+        frame->SetVelocity(Vw);
+        frame->SetBias(Bias());
+    }
+    if (step != 4)
+    {
+        Rwg_ = get_R_from_vector(twg);
     }
 }
 
 // make sure than every frame has last_frame and preintegrate
-bool Initializer::Initialize(Frames frames, double prior_a, double prior_g)
+bool Initializer::Initialize(Snapshot::Ptr snapshot)
 {
+    Frames &frames = snapshot->frames;
     // estimate velocity and gravity direction
-    EstimateVelAndRwg(frames);
+    if (!snapshot->initialized)
+    {
+        EstimateVelAndRwg(frames);
+    }
 
     // imu optimization (don't change gravity when step == 4)
     if (step != 4)
     {
-        if (!imu::InertialOptimization(frames, Rwg_, prior_a, prior_g))
+        if (!imu::InertialOptimization(frames, Rwg_, snapshot->prior_a, snapshot->prior_g))
             return false;
         Rwg_ = get_R_from_vector(Rwg_ * Vector3d::UnitZ());
-        Map::Instance().ApplyGravityRotation(Rwg_.inverse());
+        snapshot->Rwg = Rwg_;
+
+        // rotate the snapshot, the map is rotated when the result is applied
+        Quaterniond q(Rwg_.inverse());
+        for (auto &pair : frames)
+        {
+            pair.second->SetPose(q * pair.second->R(), q * pair.second->t());
+            pair.second->Vw = q * pair.second->Vw;
+        }
+        for (auto &frame : snapshot->neighbors)
+        {
+            frame->SetPose(q * frame->R(), q * frame->t());
+        }
     }
 
     for (auto &pair : frames)
@@ -49,14 +88,141 @@ bool Initializer::Initialize(Frames frames, double prior_a, double prior_g)
     }
 
     // imu optimization with visual
-    imu::FullBA(frames, prior_a, prior_g);
-    Imu::Get()->initialized = true;
+    imu::FullBA(frames, snapshot->prior_a, snapshot->prior_g);
     return true;
 }
 
+Initializer::Snapshot::Ptr Initializer::TakeSnapshot(const Frames &keyframes)
+{
+    Snapshot::Ptr snapshot(new Snapshot);
+    snapshot->keyframes = keyframes;
+    std::unordered_map<Frame *, Frame::Ptr> copies;
+    auto copy_frame = [&](Frame::Ptr frame) {
+        Frame::Ptr &copy = copies[frame.get()];
+        if (!copy)
+        {
+            copy = Frame::Ptr(new Frame(*frame));
+            copy->features_left.clear();
+            copy->features_right.clear();
+            copy->last_keyframe = nullptr;
+            copy->preintegration = nullptr;
+            copy->preintegration_last = nullptr;
+            if (keyframes.find(frame->time) == keyframes.end())
+            {
+                snapshot->neighbors.push_back(copy);
+            }
+        }
+        return copy;
+    };
+
+    for (auto &pair : keyframes)
+    {
+        Frame::Ptr frame = pair.second, copy = copy_frame(frame);
+        if (frame->preintegration)
+        {
+            copy->preintegration = frame->preintegration->Clone();
+        }
+        if (frame->last_keyframe)
+        {
+            copy->last_keyframe = copy_frame(frame->last_keyframe);
+        }
+        snapshot->frames[pair.first] = copy;
+    }
+
+    std::unordered_map<unsigned long, visual::Landmark::Ptr> landmark_copies;
+    for (auto &pair : keyframes)
+    {
+        Frame::Ptr copy = snapshot->frames[pair.first];
+        for (auto &pair_feature : pair.second->features_left)
+        {
+            auto feature = pair_feature.second;
+            auto landmark = feature->landmark.lock();
+            visual::Landmark::Ptr &landmark_copy = landmark_copies[landmark->id];
+            if (!landmark_copy)
+            {
+                landmark_copy = visual::Landmark::Ptr(new visual::Landmark(*landmark));
+                landmark_copy->observations.clear();
+                auto first_observation = visual::Feature::Ptr(new visual::Feature(*landmark->first_observation));
+                first_observation->frame = copy_frame(landmark->FirstFrame().lock());
+                first_observation->landmark = landmark_copy;
+                landmark_copy->first_observation = first_observation;
+                snapshot->landmarks.push_back(std::make_pair(landmark, landmark_copy));
+            }
+            auto feature_copy = visual::Feature::Ptr(new visual::Feature(*feature));
+            feature_copy->frame = copy;
+            feature_copy->landmark = landmark_copy;
+            copy->features_left[landmark->id] = feature_copy;
+            landmark_copy->observations[copy->id] = feature_copy;
+        }
+    }
+    return snapshot;
+}
+
+void Initializer::Apply(Snapshot::Ptr snapshot)
+{
+    if (!snapshot->success)
+    {
+        step = step != 4 ? 1 : 4;
+        Imu::Get()->initialized = false;
+        LOG(INFO) << "Initializer Failed";
+        return;
+    }
+
+    Frame::Ptr last_frame = (--snapshot->keyframes.end())->second;
+    SE3d old_pose = last_frame->pose;
+    if (step != 4)
+    {
+        Map::Instance().ApplyGravityRotation(snapshot->Rwg.inverse(), last_frame->time);
+    }
+    // when imu was already initialized, the backend kept optimizing the keyframes with imu
+    // while the worker was running, so only the gravity and the biases are taken
+    for (auto &pair : snapshot->keyframes)
+    {
+        Frame::Ptr frame = pair.second, copy = snapshot->frames[pair.first];
+        if (!snapshot->initialized)
+        {
+            frame->pose = copy->pose;
+            frame->SetVelocity(copy->Vw);
+        }
+        frame->SetBias(copy->bias);
+        frame->good_imu = true;
+        if (frame->preintegration)
+        {
+            frame->preintegration->Relinearize(copy->bias);
+        }
+    }
+    if (!snapshot->initialized)
+    {
+        for (auto &pair : snapshot->landmarks)
+        {
+            pair.first->inv_depth = pair.second->inv_depth;
+        }
+    }
+    Imu::Get()->initialized = true;
+
+    // keyframes created during initialization follow the last one
+    SE3d transform = last_frame->pose * old_pose.inverse();
+    PoseGraph::Instance().ForwardUpdate(transform, last_frame->time + epsilon);
+    LOG(INFO) << "Initializer Finished";
+}
+
 // 3-step initialization
 void Initializer::Initialize(double init_time, double end_time)
 {
+    Snapshot::Ptr finished;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (running_)
+            return;
+        finished = finished_;
+        finished_.reset();
+    }
+    if (finished)
+    {
+        Apply(finished);
+        return;
+    }
+
     static double last_init_time = 0;
     bool need_init = false;
     double prior_a = 1e4, prior_g = 1e2;
@@ -89,7 +255,6 @@ void Initializer::Initialize(double init_time, double end_time)
     }
 
     Frames frames_init;
-    SE3d old_pose, new_pose;
     if (need_init)
     {
         need_init = false;
@@ -97,7 +262,6 @@ void Initializer::Initialize(double init_time, double end_time)
         if (frames_init.size() >= num_frames_init &&
             frames_init.begin()->second->preintegration)
         {
-            old_pose = (--frames_init.end())->second->pose;
             if (!Imu::Get()->initialized)
             {
                 last_init_time = (--frames_init.end())->second->time;
@@ -108,24 +272,15 @@ void Initializer::Initialize(double init_time, double end_time)
     if (need_init)
     {
         LOG(INFO) << "Initializer Start";
-        if (Initialize(frames_init, prior_a, prior_g))
-        {
-            new_pose = (--frames_init.end())->second->pose;
-            SE3d transform = new_pose * old_pose.inverse();
-            PoseGraph::Instance().ForwardUpdate(transform, end_time, false);
-            for (auto &pair : frames_init)
-            {
-                if (pair.second->preintegration)
-                    pair.second->good_imu = true;
-            }
-            LOG(INFO) << "Initializer Finished";
-        }
-        else
+        Snapshot::Ptr snapshot = TakeSnapshot(frames_init);
+        snapshot->prior_a = prior_a;
+        snapshot->prior_g = prior_g;
+        snapshot->initialized = Imu::Get()->initialized;
         {
-            step = step != 4 ? 1 : 4;
-            Imu::Get()->initialized = false;
-            LOG(INFO) << "Initializer Failed";
+            std::unique_lock<std::mutex> lock(mutex_);
+            running_ = snapshot;
         }
+        start_.notify_one();
     }
 }
 
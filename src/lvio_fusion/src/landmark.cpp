@@ -11,11 +11,27 @@ namespace lvio_fusion
 namespace visual
 {
 unsigned long Landmark::current_landmark_id = 0;
+std::atomic<unsigned long> Landmark::num_observations(0);
 
 Vector3d Landmark::ToWorld()
 {
-    Vector3d pb = Camera::Get(1)->Pixel2Robot(cv2eigen(first_observation->keypoint.pt), 1 / inv_depth);
-    return Camera::Get()->Robot2World(pb, FirstFrame().lock()->pose);
+    const SE3d pose = FirstFrame().lock()->pose;
+    const double depth = inv_depth;
+    {
+        std::unique_lock<std::mutex> lock(mutex_cache_);
+        if (cached_ && cached_inv_depth_ == depth && std::equal(pose.data(), pose.data() + SE3d::num_parameters, cached_pose_.data()))
+            return cached_position_;
+    }
+
+    Vector3d pb = Camera::Get(1)->Pixel2Robot(cv2eigen(first_observation->keypoint.pt), 1 / depth);
+    Vector3d position = Camera::Get()->Robot2World(pb, pose);
+
+    std::unique_lock<std::mutex> lock(mutex_cache_);
+    cached_ = true;
+    cached_pose_ = pose;
+    cached_inv_depth_ = depth;
+    cached_position_ = position;
+    return position;
 }
 
 visual::Landmark::Ptr Landmark::Create(double inv_depth)
@@ -25,26 +41,28 @@ visual::Landmark::Ptr Landmark::Create(double inv_depth)
     return new_point;
 }
 
-void Landmark::Clear()
+inline std::vector<Frame::Ptr> observing_frames(const Features &observations)
 {
+    std::vector<Frame::Ptr> frames;
+    frames.reserve(observations.size());
     for (auto &pair_feature : observations)
     {
-        auto a = pair_feature.second->frame.lock();
-        pair_feature.second->frame.lock()->features_left.erase(id);
+        frames.push_back(pair_feature.second->frame.lock());
     }
-    auto right_feature = first_observation;
-    right_feature->frame.lock()->features_right.erase(id);
+    return frames;
+}
 
-    int num = 0;
-    Frames a = Map::Instance().GetKeyFrames(FirstFrame().lock()->time);
-    for (auto &i : a)
+void Landmark::Clear()
+{
+    std::vector<Frame::Ptr> frames = observing_frames(observations);
+    Frame::UpdateCovisibility(frames, -1);
+    for (auto &frame : frames)
     {
-        if (i.second->features_left.find(id) != i.second->features_left.end())
-        {
-            num++;
-        }
+        frame->features_left.erase(id);
     }
-    assert(num == 0);
+    first_observation->frame.lock()->features_right.erase(id);
+    num_observations -= observations.size();
+    observations.clear();
 }
 
 std::weak_ptr<Frame> Landmark::FirstFrame()
@@ -66,7 +84,13 @@ void Landmark::AddObservation(visual::Feature::Ptr feature)
     assert(feature->landmark.lock()->id == id);
     if (feature->is_on_left_image)
     {
-        observations[feature->frame.lock()->id] = feature;
+        auto frame = feature->frame.lock();
+        if (observations.find(frame->id) == observations.end())
+        {
+            Frame::UpdateCovisibility(frame, observing_frames(observations), 1);
+            num_observations++;
+        }
+        observations[frame->id] = feature;
     }
     else
     {
@@ -78,7 +102,12 @@ void Landmark::AddObservation(visual::Feature::Ptr feature)
 void Landmark::RemoveObservation(visual::Feature::Ptr feature)
 {
     assert(feature->is_on_left_image && feature != observations.begin()->second);
-    observations.erase(feature->frame.lock()->id);
+    auto frame = feature->frame.lock();
+    if (observations.erase(frame->id))
+    {
+        num_observations--;
+        Frame::UpdateCovisibility(frame, observing_frames(observations), -1);
+    }
 }
 } // namespace visual
 
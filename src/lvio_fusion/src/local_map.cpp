@@ -122,19 +122,99 @@ void LocalMap::UpdateCache()
 {
     std::unique_lock<std::mutex> lock(mutex_);
     pose_cache.clear();
-    position_cache.clear();
-
     for (auto &pair : local_features_)
     {
         pose_cache[pair.first] = Map::Instance().GetKeyFrame(pair.first)->pose;
     }
 
+    // update in place, positions are cached by landmarks
+    for (auto iter = position_cache.begin(); iter != position_cache.end();)
+    {
+        if (landmarks.find(iter->first) == landmarks.end())
+        {
+            iter = position_cache.erase(iter);
+        }
+        else
+        {
+            iter++;
+        }
+    }
     for (auto &pair : landmarks)
     {
         position_cache[pair.first] = pair.second->ToWorld();
     }
 }
 
+void LocalMap::ComputeCache(double time, std::unordered_map<unsigned long, Vector3d> &positions, std::unordered_map<double, SE3d> &poses)
+{
+    visual::Landmarks local_landmarks;
+    std::vector<double> local_kfs;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        local_landmarks = landmarks;
+        for (auto &pair : local_features_)
+        {
+            local_kfs.push_back(pair.first);
+        }
+    }
+
+    for (double kf_time : local_kfs)
+    {
+        if (kf_time < time)
+        {
+            poses[kf_time] = Map::Instance().GetKeyFrame(kf_time)->pose;
+        }
+    }
+
+    for (auto &pair : local_landmarks)
+    {
+        if (pair.second->FirstFrame().lock()->time < time)
+        {
+            positions[pair.first] = pair.second->ToWorld();
+        }
+    }
+}
+
+void LocalMap::UpdateCache(double time, std::unordered_map<unsigned long, Vector3d> &positions, std::unordered_map<double, SE3d> &poses)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    pose_cache.swap(poses);
+    position_cache.swap(positions);
+
+    for (auto &pair : local_features_)
+    {
+        if (pair.first >= time || pose_cache.find(pair.first) == pose_cache.end())
+        {
+            pose_cache[pair.first] = Map::Instance().GetKeyFrame(pair.first)->pose;
+        }
+    }
+
+    for (auto &pair : landmarks)
+    {
+        if (position_cache.find(pair.first) == position_cache.end() ||
+            pair.second->FirstFrame().lock()->time >= time)
+        {
+            position_cache[pair.first] = pair.second->ToWorld();
+        }
+    }
+}
+
+bool LocalMap::Contains(double time)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return local_features_.find(time) != local_features_.end();
+}
+
+void LocalMap::SetNumFeatures(int num_features)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (num_features != num_features_)
+    {
+        num_features_ = num_features;
+        extractor_.SetNumFeatures(num_features);
+    }
+}
+
 void LocalMap::GetFeaturePyramid(Frame::Ptr frame, Pyramid &pyramid)
 {
     // we don't use a mask. new feature can overlap the old.
@@ -270,21 +350,28 @@ void LocalMap::Triangulate(Frame::Ptr frame, Level &features)
 
 std::vector<double> LocalMap::GetCovisibilityKeyFrames(Frame::Ptr frame)
 {
-    std::vector<double> kfs;
+    // the most covisible keyframes first, keyframes with similar heading are kept for relocation
+    std::vector<std::pair<int, double>> candidates;
     for (auto &pair : local_features_)
     {
         assert(pair.second.size() != 0);
         if (pair.first == frame->time)
             continue;
+        int covisibility = frame->GetCovisibility(pair.first);
         Vector3d last_heading = pose_cache[pair.first].so3() * Vector3d::UnitX();
         Vector3d heading = frame->pose.so3() * Vector3d::UnitX();
         double degree = vectors_degree_angle(last_heading, heading);
-        if (degree < 30)
+        if (covisibility > 0 || degree < 30)
         {
-            kfs.push_back(pair.first);
+            candidates.push_back(std::make_pair(covisibility, pair.first));
         }
     }
-    std::sort(kfs.begin(), kfs.end(), std::greater<double>());
+    std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<int, double>>());
+    std::vector<double> kfs;
+    for (auto &pair : candidates)
+    {
+        kfs.push_back(pair.second);
+    }
     return kfs;
 }
 
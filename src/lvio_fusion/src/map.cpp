@@ -11,6 +11,12 @@ void Map::InsertKeyFrame(Frame::Ptr frame)
     keyframes[frame->time] = frame;
 }
 
+void Map::RemoveKeyFrame(Frame::Ptr frame)
+{
+    std::unique_lock<std::mutex> lock(mutex_local_kfs);
+    keyframes.erase(frame->time);
+}
+
 void Map::InsertLandmark(visual::Landmark::Ptr landmark)
 {
     std::unique_lock<std::mutex> lock(mutex_local_kfs);
@@ -89,6 +95,15 @@ void Map::RemoveLandmark(visual::Landmark::Ptr landmark)
     landmarks.erase(landmark->id);
 }
 
+size_t Map::LandmarkMemory()
+{
+    std::unique_lock<std::mutex> lock(mutex_local_kfs);
+    // a node of std::map holds the pair and 3 pointers and a color
+    const size_t node_size = sizeof(visual::Features::value_type) + 4 * sizeof(void *);
+    return landmarks.size() * (sizeof(visual::Landmark) + sizeof(visual::Landmarks::value_type) + 2 * sizeof(void *)) +
+           visual::Landmark::num_observations * (sizeof(visual::Feature) + 2 * node_size);
+}
+
 SE3d Map::ComputePose(double time)
 {
     auto frame1 = keyframes.lower_bound(time)->second;
@@ -101,10 +116,10 @@ SE3d Map::ComputePose(double time)
     return SE3d(q, t);
 }
 
-void Map::ApplyGravityRotation(const Matrix3d &R)
+void Map::ApplyGravityRotation(const Matrix3d &R, double end)
 {
     Quaterniond q(R);
-    for (auto pair : keyframes)
+    for (auto pair : end ? GetKeyFrames(0, end) : keyframes)
     {
         Frame::Ptr frame = pair.second;
         frame->SetPose(q * frame->R(), q * frame->t());
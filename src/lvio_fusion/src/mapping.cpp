@@ -1,5 +1,6 @@
 #include "lvio_fusion/lidar/mapping.h"
 #include "lvio_fusion/adapt/problem.h"
+#include "lvio_fusion/backend.h"
 #include "lvio_fusion/ceres/lidar_error.hpp"
 #include "lvio_fusion/lidar/lidar.h"
 #include "lvio_fusion/loop/pose_graph.h"
@@ -11,6 +12,34 @@
 namespace lvio_fusion
 {
 
+Mapping::Mapping()
+{
+    thread_ = std::thread(std::bind(&Mapping::MappingLoop, this));
+}
+
+void Mapping::AddKeyFrames(const Frames &kfs)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_queue_);
+        queue_.insert(kfs.begin(), kfs.end());
+    }
+    new_kfs_.notify_one();
+}
+
+void Mapping::MappingLoop()
+{
+    while (true)
+    {
+        Frames active_kfs;
+        {
+            std::unique_lock<std::mutex> lock(mutex_queue_);
+            new_kfs_.wait(lock, [this] { return !queue_.empty(); });
+            active_kfs.swap(queue_);
+        }
+        Optimize(active_kfs);
+    }
+}
+
 inline void Mapping::Color(const PointICloud &points_ground, const PointICloud &points_surf, Frame::Ptr frame, PointRGBCloud &out)
 {
     for (int i = 0; i < points_ground.size(); i++)
@@ -39,7 +68,9 @@ inline void Mapping::Color(const PointICloud &points_ground, const PointICloud &
 
 Frames get_lidar_frames(double start, double end, int num)
 {
-    auto keyframes = Map::Instance().keyframes;
+    // the frontend inserts and the backend removes keyframes while mapping
+    std::unique_lock<std::mutex> lock(Map::Instance().mutex_local_kfs);
+    auto &keyframes = Map::Instance().keyframes;
     if (end == 0)
     {
         auto iter = keyframes.upper_bound(start);
@@ -75,7 +106,58 @@ Frames get_lidar_frames(double start, double end, int num)
     return Frames();
 }
 
-void Mapping::BuildOldMapFrame(Frame::Ptr old_frame, Frame::Ptr map_frame)
+Frame::Ptr Mapping::BuildMapFrame(const Frames &frames, Frame::Ptr base, MapFrameCache &cache)
+{
+    std::vector<double> stamp;
+    PointICloud points_surf_merged;
+    PointICloud points_ground_merged;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto &pair : frames)
+        {
+            stamp.push_back(pair.first);
+            stamp.push_back(versions_[pair.first]);
+        }
+        stamp.insert(stamp.end(), base->pose.data(), base->pose.data() + SE3d::num_parameters);
+        if (cache.map_frame && cache.stamp == stamp)
+            return cache.map_frame;
+        for (auto &pair : frames)
+        {
+            points_surf_merged += pointclouds_surf[pair.first];
+            points_ground_merged += pointclouds_ground[pair.first];
+        }
+    }
+
+    association_->SegmentGround(points_ground_merged);
+
+    Frame::Ptr map_frame = Frame::Ptr(new Frame());
+    map_frame->id = base->id;
+    map_frame->time = base->time;
+    map_frame->pose = base->pose;
+    map_frame->feature_lidar = lidar::Feature::Create();
+    auto feature = map_frame->feature_lidar;
+    feature->points_surf.swap(points_surf_merged);
+    feature->points_ground.swap(points_ground_merged);
+    // the kd-trees refer to the points of the feature without copying, and are released before them
+    auto no_delete = [](PointICloud *) {};
+    if (!feature->points_surf.empty())
+    {
+        feature->kdtree_surf.reset(new pcl::KdTreeFLANN<PointI>);
+        feature->kdtree_surf->setInputCloud(PointICloud::Ptr(&feature->points_surf, no_delete));
+    }
+    if (!feature->points_ground.empty())
+    {
+        feature->kdtree_ground.reset(new pcl::KdTreeFLANN<PointI>);
+        feature->kdtree_ground->setInputCloud(PointICloud::Ptr(&feature->points_ground, no_delete));
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cache.stamp = stamp;
+    cache.map_frame = map_frame;
+    return map_frame;
+}
+
+Frame::Ptr Mapping::BuildOldMapFrame(Frame::Ptr old_frame)
 {
     Frames old_frames;
     Frames prev_old_frames = get_lidar_frames(0, old_frame->time, 1);
@@ -92,48 +174,19 @@ void Mapping::BuildOldMapFrame(Frame::Ptr old_frame, Frame::Ptr map_frame)
     {
         old_frames[old_frame->time] = old_frame;
     }
-
-    PointICloud points_surf_merged;
-    PointICloud points_ground_merged;
-    for (auto &pair : old_frames)
-    {
-        points_surf_merged += pointclouds_surf[pair.first];
-        points_ground_merged += pointclouds_ground[pair.first];
-    }
-
-    association_->SegmentGround(points_ground_merged);
-
-    map_frame->id = old_frames.begin()->second->id;
-    map_frame->time = old_frames.begin()->second->time;
-    map_frame->pose = old_frames.begin()->second->pose;
-    map_frame->feature_lidar = lidar::Feature::Create();
-    map_frame->feature_lidar->points_surf = points_surf_merged;
-    map_frame->feature_lidar->points_ground = points_ground_merged;
+    if (old_frames.empty())
+        return nullptr;
+    return BuildMapFrame(old_frames, old_frames.begin()->second, cache_old_);
 }
 
-void Mapping::BuildMapFrame(Frame::Ptr frame, Frame::Ptr map_frame)
+Frame::Ptr Mapping::BuildMapFrame(Frame::Ptr frame)
 {
     double start_time = frame->time;
     static int num_last_frames = 3;
     Frames last_frames = get_lidar_frames(0, start_time, num_last_frames);
     if (last_frames.empty())
-        return;
-    PointICloud points_surf_merged;
-    PointICloud points_ground_merged;
-    for (auto &pair : last_frames)
-    {
-        points_surf_merged += pointclouds_surf[pair.first];
-        points_ground_merged += pointclouds_ground[pair.first];
-    }
-
-    association_->SegmentGround(points_ground_merged);
-
-    map_frame->id = (--last_frames.end())->second->id;
-    map_frame->time = (--last_frames.end())->second->time;
-    map_frame->pose = (--last_frames.end())->second->pose;
-    map_frame->feature_lidar = lidar::Feature::Create();
-    map_frame->feature_lidar->points_surf = points_surf_merged;
-    map_frame->feature_lidar->points_ground = points_ground_merged;
+        return nullptr;
+    return BuildMapFrame(last_frames, (--last_frames.end())->second, cache_);
 }
 
 void Mapping::Optimize(Frames &active_kfs)
@@ -144,43 +197,58 @@ void Mapping::Optimize(Frames &active_kfs)
         if (!pair.second->feature_lidar)
             continue;
         auto t1 = std::chrono::steady_clock::now();
-        SE3d old_pose = pair.second->pose;
+        // register a copy, the keyframe may be moved by others meanwhile
+        Frame::Ptr frame = Frame::Ptr(new Frame());
+        {
+            // the features weigh the pose prior, and are pruned by the backend
+            std::unique_lock<std::mutex> lock(backend_.lock()->mutex);
+            frame->id = pair.second->id;
+            frame->time = pair.second->time;
+            frame->pose = pair.second->pose;
+            frame->weights = pair.second->weights;
+            frame->features_left = pair.second->features_left;
+            frame->feature_lidar = pair.second->feature_lidar;
+        }
+        SE3d old_pose = frame->pose;
         {
-            auto map_frame = Frame::Ptr(new Frame());
-            BuildMapFrame(pair.second, map_frame);
-            if (map_frame->feature_lidar && pair.second->feature_lidar)
+            Frame::Ptr map_frame = BuildMapFrame(frame);
+            if (map_frame)
             {
                 double rpyxyz[6];
-                se32rpyxyz(map_frame->pose.inverse() * pair.second->pose, rpyxyz); // relative_i_j
+                se32rpyxyz(map_frame->pose.inverse() * frame->pose, rpyxyz); // relative_i_j
                 if (!map_frame->feature_lidar->points_ground.empty())
                 {
                     adapt::Problem problem;
-                    association_->ScanToMapWithGround(pair.second, map_frame, rpyxyz, problem);
+                    association_->ScanToMapWithGround(frame, map_frame, rpyxyz, problem);
                     ceres::Solver::Options options;
                     options.linear_solver_type = ceres::DENSE_QR;
                     options.max_num_iterations = 4;
                     options.num_threads = num_threads;
                     ceres::Solver::Summary summary;
                     adapt::Solve(options, &problem, &summary);
-                    pair.second->pose = map_frame->pose * rpyxyz2se3(rpyxyz);
+                    frame->pose = map_frame->pose * rpyxyz2se3(rpyxyz);
                 }
                 if (!map_frame->feature_lidar->points_surf.empty())
                 {
                     adapt::Problem problem;
-                    association_->ScanToMapWithSegmented(pair.second, map_frame, rpyxyz, problem);
+                    association_->ScanToMapWithSegmented(frame, map_frame, rpyxyz, problem);
                     ceres::Solver::Options options;
                     options.linear_solver_type = ceres::DENSE_QR;
                     options.max_num_iterations = 4;
                     options.num_threads = num_threads;
                     ceres::Solver::Summary summary;
                     adapt::Solve(options, &problem, &summary);
-                    pair.second->pose = map_frame->pose * rpyxyz2se3(rpyxyz);
+                    frame->pose = map_frame->pose * rpyxyz2se3(rpyxyz);
                 }
             }
         }
-        SE3d new_pose = pair.second->pose;
-        SE3d transform = new_pose * old_pose.inverse();
-        PoseGraph::Instance().ForwardUpdate(transform, pair.first + epsilon);
+        // move the keyframe and the later ones like other corrections
+        SE3d transform = frame->pose * old_pose.inverse();
+        {
+            auto backend = backend_.lock();
+            std::unique_lock<std::mutex> lock(backend->mutex);
+            PoseGraph::Instance().ForwardUpdate(transform, pair.first);
+        }
 
         ToWorld(pair.second);
 
@@ -214,6 +282,8 @@ void Mapping::ToWorld(Frame::Ptr frame)
         MergeScan(frame->feature_lidar->points_ground, frame->pose, pointcloud_ground);
         Color(pointcloud_ground, pointcloud_surf, frame, pointcloud_color);
     }
+    std::unique_lock<std::mutex> lock(mutex_);
+    versions_[frame->time]++;
     pointclouds_surf[frame->time] = pointcloud_surf;
     pointclouds_ground[frame->time] = pointcloud_ground;
     pointclouds_color[frame->time] = pointcloud_color;
@@ -231,10 +301,13 @@ void Mapping::ToWorld(double start)
 PointRGBCloud Mapping::GetGlobalMap()
 {
     PointRGBCloud global_map;
-    for (auto &pair_pc : pointclouds_color)
     {
-        auto &pointcloud = pair_pc.second;
-        global_map.insert(global_map.end(), pointcloud.begin(), pointcloud.end());
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto &pair_pc : pointclouds_color)
+        {
+            auto &pointcloud = pair_pc.second;
+            global_map.insert(global_map.end(), pointcloud.begin(), pointcloud.end());
+        }
     }
     if (global_map.size() > 0)
     {
@@ -248,6 +321,15 @@ PointRGBCloud Mapping::GetGlobalMap()
     return global_map;
 }
 
+void Mapping::RemovePointClouds(double start, double end)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    pointclouds_surf.erase(pointclouds_surf.lower_bound(start), pointclouds_surf.upper_bound(end));
+    pointclouds_ground.erase(pointclouds_ground.lower_bound(start), pointclouds_ground.upper_bound(end));
+    pointclouds_color.erase(pointclouds_color.lower_bound(start), pointclouds_color.upper_bound(end));
+    versions_.erase(versions_.lower_bound(start), versions_.upper_bound(end));
+}
+
 int Mapping::Relocate(Frame::Ptr last_frame, Frame::Ptr current_frame, SE3d &relative_o_c)
 {
     // init relative pose
@@ -256,8 +338,9 @@ int Mapping::Relocate(Frame::Ptr last_frame, Frame::Ptr current_frame, SE3d &rel
     clone_frame->pose = last_frame->pose * clone_frame->loop_closure->relative_o_c;
 
     // build two pointclouds
-    Frame::Ptr map_frame = Frame::Ptr(new Frame());
-    BuildOldMapFrame(last_frame, map_frame);
+    Frame::Ptr map_frame = BuildOldMapFrame(last_frame);
+    if (!map_frame)
+        return 0;
 
     // optimize
     double score_ground, score_surf;
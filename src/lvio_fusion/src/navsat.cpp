@@ -196,8 +196,8 @@ void Navsat::OptimizeBC(Frame::Ptr frame, double end, unsigned char mode)
         frames_distance(frame->time, end) < trust_distance_yaw_)
         return;
     SE3d old_pose = frame->pose;
-    ceres::Problem problem;
-    ceres::LossFunction *loss_function = new ceres::HuberLoss(0.1);
+    adapt::Problem problem;
+    ceres::LossFunction *loss_function = problem.New<ceres::HuberLoss>(0.1);
     Frames active_kfs = Map::Instance().GetKeyFrames(frame->time, end);
     double para[6] = {0, 0, 0, 0, 0, 0};
     //NOTE: the real order of rpy is y p r
@@ -224,7 +224,7 @@ void Navsat::OptimizeBC(Frame::Ptr frame, double end, unsigned char mode)
                 y += frame->pose.inverse().so3() * origin.so3() * Vector3d::UnitY();
             }
             ceres::CostFunction *cost_function = NavsatRError::Create(y, frame->pose);
-            problem.AddResidualBlock(cost_function, NULL, para + 2);
+            problem.AddResidualBlock(ProblemType::NavsatError, cost_function, NULL, para + 2);
             ceres::Solver::Options options;
             options.linear_solver_type = ceres::DENSE_QR;
             ceres::Solver::Summary summary;
@@ -254,7 +254,7 @@ void Navsat::OptimizeBC(Frame::Ptr frame, double end, unsigned char mode)
             Vector3d point = GetFixPoint(pair.second);
             Vector3d cov = pair.second->feature_navsat->cov;
             ceres::CostFunction *cost_function = NavsatRXError::Create(point, frame->pose.inverse() * origin.translation(), frame->pose, cov);
-            problem.AddResidualBlock(cost_function, loss_function, para, para + 1, para + 2, para + 3, para + 4, para + 5);
+            problem.AddResidualBlock(ProblemType::NavsatError, cost_function, loss_function, para, para + 1, para + 2, para + 3, para + 4, para + 5);
         }
     }
     ceres::Solver::Options options;
@@ -1,5 +1,7 @@
 #include "lvio_fusion/loop/pose_graph.h"
+#include "lvio_fusion/backend.h"
 #include "lvio_fusion/ceres/pose_error.hpp"
+#include "lvio_fusion/imu/tools.h"
 #include "lvio_fusion/utility.h"
 
 namespace lvio_fusion
@@ -160,12 +162,61 @@ bool PoseGraph::AddSection(double time)
     return false;
 }
 
+bool PoseGraph::IsAnchor(double time)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto is_end = [time](const Section &section) {
+        return section.A == time || section.B == time || section.C == time;
+    };
+    if (is_end(current_section))
+        return true;
+    for (auto atlas : {&sections_, &submaps_})
+    {
+        for (auto &pair : *atlas)
+        {
+            if (is_end(pair.second))
+                return true;
+        }
+    }
+    return false;
+}
+
+void PoseGraph::ExtractSections(double start, double end, Atlas &sections, Atlas &submaps)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto iter = sections_.lower_bound(start); iter != sections_.end() && iter->second.C <= end;)
+    {
+        sections.insert(*iter);
+        iter = sections_.erase(iter);
+    }
+    auto end_iter = submaps_.upper_bound(end);
+    for (auto iter = submaps_.lower_bound(start); iter != end_iter;)
+    {
+        if (iter->second.A >= start)
+        {
+            submaps.insert(*iter);
+            iter = submaps_.erase(iter);
+        }
+        else
+        {
+            iter++;
+        }
+    }
+}
+
+void PoseGraph::RestoreSections(const Atlas &sections, const Atlas &submaps)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    sections_.insert(sections.begin(), sections.end());
+    submaps_.insert(submaps.begin(), submaps.end());
+}
+
 void PoseGraph::BuildProblem(Atlas &sections, Section &submap, adapt::Problem &problem)
 {
     if (sections.empty())
         return;
 
-    ceres::LocalParameterization *local_parameterization = new ceres::ProductParameterization(
+    ceres::LocalParameterization *local_parameterization = problem.New<ceres::ProductParameterization>(
         new ceres::EigenQuaternionParameterization(),
         new ceres::IdentityParameterization(3));
 
@@ -224,21 +275,34 @@ void PoseGraph::Optimize(Atlas &sections, Section &submap, adapt::Problem &probl
 }
 
 // new pose = transform * old pose;
-void PoseGraph::ForwardUpdate(SE3d transform, double start_time, bool need_lock)
+void PoseGraph::ForwardUpdate(SE3d transform, double start_time, Correction::Ptr correction)
 {
-    std::unique_lock<std::mutex> lock(frontend_->mutex, std::defer_lock);
-    if (need_lock)
+    Frames forward_kfs;
     {
-        lock.lock();
+        // keyframes inserted later are moved by the frontend
+        std::unique_lock<std::mutex> lock(Map::Instance().mutex_local_kfs);
+        forward_kfs = Map::Instance().GetKeyFrames(start_time);
     }
-    Frames forward_kfs = Map::Instance().GetKeyFrames(start_time);
-    Frame::Ptr last_frame = frontend_->last_frame;
-    if (forward_kfs.find(last_frame->time) == forward_kfs.end())
+    // keyframes after the active window are not solved yet, the frontend moves them under the backend lock
+    auto backend = backend_.lock();
+    forward_kfs.erase(forward_kfs.upper_bound(backend ? backend->active_end : 0), forward_kfs.end());
+    ForwardUpdate(transform, forward_kfs);
+
+    correction = correction ? correction : Correction::Ptr(new Correction);
+    if (correction->update_imu && !forward_kfs.empty())
     {
-        forward_kfs[last_frame->time] = last_frame;
+        // repredict before posting, the frontend repredicts only the frames it moves
+        Frames prior_kfs = Map::Instance().GetKeyFrames(0, start_time, 1);
+        if (!prior_kfs.empty())
+        {
+            Frame::Ptr prior_frame = prior_kfs.begin()->second;
+            imu::RePredictVel(forward_kfs, prior_frame);
+        }
     }
-    ForwardUpdate(transform, forward_kfs);
-    frontend_->UpdateCache();
+    correction->time = start_time;
+    correction->last_time = forward_kfs.empty() ? start_time - epsilon : (--forward_kfs.end())->first;
+    correction->transform = transform;
+    frontend_->PostCorrection(correction);
 }
 
 // new pose = transform * old pose;
@@ -0,0 +1,98 @@
+#include "lvio_fusion/visual/pose_solver.h"
+#include "lvio_fusion/utility.h"
+
+namespace lvio_fusion
+{
+
+double PoseSolver::Linearize(const std::vector<cv::Point3f> &points_3d, const std::vector<cv::Point2f> &points_2d, const SE3d &Tbw,
+                             Matrix<double, 6, 6> &H, Matrix<double, 6, 1> &b, int &num_inliers)
+{
+    const double fx = camera_.fx, fy = camera_.fy, cx = camera_.cx, cy = camera_.cy;
+    const Matrix3d Rbw = Tbw.rotationMatrix();
+    const Vector3d tbw = Tbw.translation();
+    H.setZero();
+    b.setZero();
+    num_inliers = 0;
+    double cost = 0;
+    for (int i = 0; i < points_3d.size(); i++)
+    {
+        Vector3d pw(points_3d[i].x, points_3d[i].y, points_3d[i].z);
+        Vector3d pb = Rbw * pw + tbw;
+        Vector3d pc;
+        camera_.Robot2Sensor(pb.data(), pc.data());
+        if (pc.z() < epsilon)
+            continue;
+        double inv_z = 1 / pc.z(), inv_z2 = inv_z * inv_z;
+        Vector2d e(fx * pc.x() * inv_z + cx - points_2d[i].x,
+                   fy * pc.y() * inv_z + cy - points_2d[i].y);
+
+        // left perturbation of Tbw: d(pb) = [I, -pb^] * [d_rho, d_phi]
+        Matrix<double, 2, 3> J_pc;
+        J_pc << fx * inv_z, 0, -fx * pc.x() * inv_z2,
+            0, fy * inv_z, -fy * pc.y() * inv_z2;
+        Matrix<double, 3, 6> J_pb;
+        J_pb << Matrix3d::Identity(), -skew_symmetric(pb);
+        Matrix<double, 2, 6> J = J_pc * Rcb_ * J_pb;
+
+        double norm = e.norm(), w = 1;
+        if (norm <= huber_)
+        {
+            cost += 0.5 * norm * norm;
+        }
+        else
+        {
+            cost += huber_ * (norm - 0.5 * huber_);
+            w = huber_ / norm;
+        }
+        if (norm < 3 * huber_)
+        {
+            num_inliers++;
+        }
+        H.noalias() += w * J.transpose() * J;
+        b.noalias() -= w * J.transpose() * e;
+    }
+    return cost;
+}
+
+int PoseSolver::Solve(const std::vector<cv::Point3f> &points_3d, const std::vector<cv::Point2f> &points_2d, SE3d &pose)
+{
+    assert(points_3d.size() == points_2d.size());
+    if (points_3d.size() < 3)
+        return 0;
+
+    Matrix<double, 6, 6> H;
+    Matrix<double, 6, 1> b;
+    SE3d Tbw = pose.inverse(), last_Tbw = Tbw;
+    int num_inliers = 0, last_num_inliers = 0;
+    double last_cost = std::numeric_limits<double>::max();
+    for (int i = 0; i <= max_iterations_; i++)
+    {
+        double cost = Linearize(points_3d, points_2d, Tbw, H, b, num_inliers);
+        if (cost >= last_cost)
+        {
+            // diverged, go back to the last step
+            Tbw = last_Tbw;
+            num_inliers = last_num_inliers;
+            break;
+        }
+        last_Tbw = Tbw;
+        last_cost = cost;
+        last_num_inliers = num_inliers;
+        if (i == max_iterations_)
+            break;
+
+        Matrix<double, 6, 1> dx = H.ldlt().solve(b);
+        if (!dx.allFinite())
+            break;
+        Tbw = SE3d::exp(dx) * Tbw;
+        if (dx.norm() < 1e-6)
+        {
+            Linearize(points_3d, points_2d, Tbw, H, b, num_inliers);
+            break;
+        }
+    }
+    pose = Tbw.inverse();
+    return num_inliers;
+}
+
+} // namespace lvio_fusion
@@ -12,6 +12,17 @@ namespace imu
 int O_T = 0, O_R = 3, O_V = 6, O_BA = 9, O_BG = 12, O_PR = 0, O_PT = 4;
 Vector3d g(0, 0, 9.81007);
 
+// buffers of released preintegrations are kept by the releasing thread, and reused without locking
+struct BufferPool
+{
+    ~BufferPool();
+    std::vector<std::vector<Preintegration::Sample>> buffers;
+};
+const int max_pool_size = 32;
+thread_local bool pool_destroyed = false;
+thread_local BufferPool pool;
+BufferPool::~BufferPool() { pool_destroyed = true; }
+
 Preintegration::Preintegration(const Vector3d &_linearized_ba, const Vector3d &_linearized_bg)
     : linearized_ba{_linearized_ba}, linearized_bg{_linearized_bg},
       jacobian{Matrix<double, 15, 15>::Identity()}, covariance{Matrix<double, 15, 15>::Zero()},
@@ -25,6 +36,56 @@ Preintegration::Preintegration(const Vector3d &_linearized_ba, const Vector3d &_
     noise.block<3, 3>(9, 9) = (Imu::Get()->GYR_N * Imu::Get()->GYR_N) * Matrix3d::Identity();
     noise.block<3, 3>(12, 12) = (Imu::Get()->ACC_W * Imu::Get()->ACC_W) * Matrix3d::Identity();
     noise.block<3, 3>(15, 15) = (Imu::Get()->GYR_W * Imu::Get()->GYR_W) * Matrix3d::Identity();
+    if (!pool_destroyed && !pool.buffers.empty())
+    {
+        buf = std::move(pool.buffers.back());
+        pool.buffers.pop_back();
+    }
+}
+
+Preintegration::~Preintegration()
+{
+    if (!pool_destroyed && pool.buffers.size() < max_pool_size)
+    {
+        buf.clear();
+        pool.buffers.push_back(std::move(buf));
+    }
+}
+
+Preintegration::Ptr Preintegration::Clone()
+{
+    Preintegration::Ptr copy(new Preintegration(linearized_ba, linearized_bg));
+    copy->dt = dt;
+    copy->sum_dt = sum_dt;
+    copy->buf.assign(buf.begin(), buf.end());
+    copy->acc0 = acc0;
+    copy->gyr0 = gyr0;
+    copy->acc1 = acc1;
+    copy->gyr1 = gyr1;
+    copy->linearized_acc = linearized_acc;
+    copy->linearized_gyr = linearized_gyr;
+    copy->delta_p = delta_p;
+    copy->delta_q = delta_q;
+    copy->delta_v = delta_v;
+    copy->delta_bias = delta_bias;
+    copy->jacobian = jacobian;
+    copy->covariance = covariance;
+    copy->noise = noise;
+    return copy;
+}
+
+Preintegration::Ptr Preintegration::Merge(Preintegration::Ptr a, Preintegration::Ptr b, const Bias &bias)
+{
+    Preintegration::Ptr merged = Create(bias);
+    Vector3d acc0 = a->linearized_acc, gyr0 = a->linearized_gyr;
+    for (auto preintegration : {a, b})
+    {
+        for (auto &sample : preintegration->buf)
+        {
+            merged->Append(sample.dt, sample.acc, sample.gyr, acc0, gyr0);
+        }
+    }
+    return merged;
 }
 
 void Preintegration::MidPointIntegration(
@@ -48,54 +109,57 @@ void Preintegration::MidPointIntegration(
 
     if (update_jacobian)
     {
-        Vector3d w_x = 0.5 * (_gyr_0 + _gyr_1) - linearized_bg;
-        Vector3d a_0_x = _acc_0 - linearized_ba;
-        Vector3d a_1_x = _acc_1 - linearized_ba;
-        Matrix3d R_w_x, R_a_0_x, R_a_1_x;
+        Matrix3d R_w_x = skew_symmetric(0.5 * (_gyr_0 + _gyr_1) - linearized_bg);
+        Matrix3d R_a_0_x = skew_symmetric(_acc_0 - linearized_ba);
+        Matrix3d R_a_1_x = skew_symmetric(_acc_1 - linearized_ba);
+        Matrix3d R_0 = delta_q.toRotationMatrix();
+        Matrix3d R_1 = result_delta_q.toRotationMatrix();
+        Matrix3d R_1_a_1_x = R_1 * R_a_1_x;
+        Matrix3d I_w_x = Matrix3d::Identity() - R_w_x * _dt;
+        double dt2 = _dt * _dt;
 
-        R_w_x << 0, -w_x(2), w_x(1),
-            w_x(2), 0, -w_x(0),
-            -w_x(1), w_x(0), 0;
-        R_a_0_x << 0, -a_0_x(2), a_0_x(1),
-            a_0_x(2), 0, -a_0_x(0),
-            -a_0_x(1), a_0_x(0), 0;
-        R_a_1_x << 0, -a_1_x(2), a_1_x(1),
-            a_1_x(2), 0, -a_1_x(0),
-            -a_1_x(1), a_1_x(0), 0;
+        // nonzero blocks of F, the others are I or I * dt:
+        // | I  F_pr  I*dt  F_pba  F_pbg |
+        // | 0  F_rr  0     0      -I*dt |
+        // | 0  F_vr  I     F_vba  F_vbg |
+        // | 0  0     0     I      0     |
+        // | 0  0     0     0      I     |
+        Matrix3d F_pr = -0.25 * R_0 * R_a_0_x * dt2 + -0.25 * R_1_a_1_x * I_w_x * dt2;
+        Matrix3d F_pba = -0.25 * (R_0 + R_1) * dt2;
+        Matrix3d F_pbg = 0.25 * R_1_a_1_x * dt2 * _dt;
+        Matrix3d F_rr = I_w_x;
+        Matrix3d F_vr = -0.5 * R_0 * R_a_0_x * _dt + -0.5 * R_1_a_1_x * I_w_x * _dt;
+        Matrix3d F_vba = -0.5 * (R_0 + R_1) * _dt;
+        Matrix3d F_vbg = 0.5 * R_1_a_1_x * dt2;
 
-        MatrixXd F = MatrixXd::Zero(15, 15);
-        F.block<3, 3>(0, 0) = Matrix3d::Identity();
-        F.block<3, 3>(0, 3) = -0.25 * delta_q.toRotationMatrix() * R_a_0_x * _dt * _dt +
-                              -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt * _dt;
-        F.block<3, 3>(0, 6) = MatrixXd::Identity(3, 3) * _dt;
-        F.block<3, 3>(0, 9) = -0.25 * (delta_q.toRotationMatrix() + result_delta_q.toRotationMatrix()) * _dt * _dt;
-        F.block<3, 3>(0, 12) = -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * _dt * _dt * -_dt;
-        F.block<3, 3>(3, 3) = Matrix3d::Identity() - R_w_x * _dt;
-        F.block<3, 3>(3, 12) = -1.0 * MatrixXd::Identity(3, 3) * _dt;
-        F.block<3, 3>(6, 3) = -0.5 * delta_q.toRotationMatrix() * R_a_0_x * _dt +
-                              -0.5 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt;
-        F.block<3, 3>(6, 6) = Matrix3d::Identity();
-        F.block<3, 3>(6, 9) = -0.5 * (delta_q.toRotationMatrix() + result_delta_q.toRotationMatrix()) * _dt;
-        F.block<3, 3>(6, 12) = -0.5 * result_delta_q.toRotationMatrix() * R_a_1_x * _dt * -_dt;
-        F.block<3, 3>(9, 9) = Matrix3d::Identity();
-        F.block<3, 3>(12, 12) = Matrix3d::Identity();
+        // X = F * X, rows of bias are unchanged
+        auto propagate = [&](Matrix<double, 15, 15> &X) {
+            Matrix<double, 3, 15> X_r = X.middleRows<3>(3);
+            Matrix<double, 3, 15> X_v = X.middleRows<3>(6);
+            X.middleRows<3>(0) += F_pr * X_r + _dt * X_v + F_pba * X.middleRows<3>(9) + F_pbg * X.middleRows<3>(12);
+            X.middleRows<3>(3) = F_rr * X_r - _dt * X.middleRows<3>(12);
+            X.middleRows<3>(6) = F_vr * X_r + X_v + F_vba * X.middleRows<3>(9) + F_vbg * X.middleRows<3>(12);
+        };
+        propagate(jacobian);
+        propagate(covariance);
+        Matrix<double, 15, 15> covariance_t = covariance.transpose();
+        propagate(covariance_t);
+        covariance = covariance_t.transpose();
 
-        MatrixXd V = MatrixXd::Zero(15, 18);
-        V.block<3, 3>(0, 0) = 0.25 * delta_q.toRotationMatrix() * _dt * _dt;
-        V.block<3, 3>(0, 3) = 0.25 * -result_delta_q.toRotationMatrix() * R_a_1_x * _dt * _dt * 0.5 * _dt;
-        V.block<3, 3>(0, 6) = 0.25 * result_delta_q.toRotationMatrix() * _dt * _dt;
-        V.block<3, 3>(0, 9) = V.block<3, 3>(0, 3);
-        V.block<3, 3>(3, 3) = 0.5 * MatrixXd::Identity(3, 3) * _dt;
-        V.block<3, 3>(3, 9) = 0.5 * MatrixXd::Identity(3, 3) * _dt;
-        V.block<3, 3>(6, 0) = 0.5 * delta_q.toRotationMatrix() * _dt;
-        V.block<3, 3>(6, 3) = 0.5 * -result_delta_q.toRotationMatrix() * R_a_1_x * _dt * 0.5 * _dt;
-        V.block<3, 3>(6, 6) = 0.5 * result_delta_q.toRotationMatrix() * _dt;
-        V.block<3, 3>(6, 9) = V.block<3, 3>(6, 3);
-        V.block<3, 3>(9, 12) = MatrixXd::Identity(3, 3) * _dt;
-        V.block<3, 3>(12, 15) = MatrixXd::Identity(3, 3) * _dt;
-
-        jacobian = F * jacobian;
-        covariance = F * covariance * F.transpose() + V * noise * V.transpose();
+        // V * noise * V^T, noise is block diagonal and V only has 3 column blocks on the rows of p, r, v
+        Matrix<double, 9, 3> G_a0 = Matrix<double, 9, 3>::Zero(), G_g = Matrix<double, 9, 3>::Zero(), G_a1 = Matrix<double, 9, 3>::Zero();
+        G_a0.block<3, 3>(0, 0) = 0.25 * R_0 * dt2;
+        G_a0.block<3, 3>(6, 0) = 0.5 * R_0 * _dt;
+        G_g.block<3, 3>(0, 0) = -0.125 * R_1_a_1_x * dt2 * _dt;
+        G_g.block<3, 3>(3, 0) = 0.5 * _dt * Matrix3d::Identity();
+        G_g.block<3, 3>(6, 0) = -0.25 * R_1_a_1_x * dt2;
+        G_a1.block<3, 3>(0, 0) = 0.25 * R_1 * dt2;
+        G_a1.block<3, 3>(6, 0) = 0.5 * R_1 * _dt;
+        covariance.topLeftCorner<9, 9>() += G_a0 * noise.block<3, 3>(0, 0) * G_a0.transpose() +
+                                            G_g * (noise.block<3, 3>(3, 3) + noise.block<3, 3>(9, 9)) * G_g.transpose() +
+                                            G_a1 * noise.block<3, 3>(6, 6) * G_a1.transpose();
+        covariance.block<3, 3>(9, 9) += dt2 * noise.block<3, 3>(12, 12);
+        covariance.block<3, 3>(12, 12) += dt2 * noise.block<3, 3>(15, 15);
     }
 }
 
@@ -124,6 +188,9 @@ void Preintegration::Propagate(double _dt, const Vector3d &_acc_1, const Vector3
     sum_dt += dt;
     acc0 = acc1;
     gyr0 = gyr1;
+
+    std::unique_lock<std::mutex> lock(mutex_sqrt_info_);
+    sqrt_info_valid_ = sqrt_info_prior_valid_ = false;
 }
 void Preintegration::Repropagate(const Vector3d &_linearized_ba, const Vector3d &_linearized_bg)
 {
@@ -137,8 +204,20 @@ void Preintegration::Repropagate(const Vector3d &_linearized_ba, const Vector3d
     linearized_bg = _linearized_bg;
     jacobian.setIdentity();
     covariance.setZero();
-    for (int i = 0; i < static_cast<int>(dt_buf.size()); i++)
-        Propagate(dt_buf[i], acc_buf[i], gyr_buf[i]);
+    for (auto &sample : buf)
+        Propagate(sample.dt, sample.acc, sample.gyr);
+}
+
+bool Preintegration::Relinearize(const Bias &bias)
+{
+    bool repropagate = (bias.linearized_ba - linearized_ba).norm() > Imu::Get()->REPROPAGATE_BA ||
+                       (bias.linearized_bg - linearized_bg).norm() > Imu::Get()->REPROPAGATE_BG;
+    if (repropagate)
+    {
+        Repropagate(bias.linearized_ba, bias.linearized_bg);
+    }
+    UpdateBias(bias);
+    return repropagate;
 }
 
 Matrix<double, 15, 1> Preintegration::Evaluate(
@@ -253,6 +332,33 @@ Bias Preintegration::GetDeltaBias(const Bias &b_)
     return Bias(dba, dbg);
 }
 
+Matrix<double, 15, 15> Preintegration::SqrtInfo()
+{
+    std::unique_lock<std::mutex> lock(mutex_sqrt_info_);
+    if (!sqrt_info_valid_)
+    {
+        sqrt_info_ = LLT<Matrix<double, 15, 15>>(covariance.inverse()).matrixL().transpose();
+        sqrt_info_valid_ = true;
+    }
+    return sqrt_info_;
+}
+
+Matrix<double, 15, 15> Preintegration::SqrtInfo(double prior_a, double prior_g)
+{
+    std::unique_lock<std::mutex> lock(mutex_sqrt_info_);
+    if (!sqrt_info_prior_valid_ || prior_a != prior_a_ || prior_g != prior_g_)
+    {
+        Matrix<double, 15, 15> cov_inv = covariance.inverse();
+        cov_inv.block<3, 3>(9, 9) = prior_a * Matrix3d::Identity();
+        cov_inv.block<3, 3>(12, 12) = prior_g * Matrix3d::Identity();
+        sqrt_info_prior_ = LLT<Matrix<double, 15, 15>>(cov_inv).matrixL().transpose();
+        prior_a_ = prior_a;
+        prior_g_ = prior_g;
+        sqrt_info_prior_valid_ = true;
+    }
+    return sqrt_info_prior_;
+}
+
 } // namespace imu
 
 } // namespace lvio_fusion
\ No newline at end of file
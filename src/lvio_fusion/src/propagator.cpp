@@ -0,0 +1,138 @@
+#include "lvio_fusion/imu/propagator.h"
+#include "lvio_fusion/utility.h"
+
+namespace lvio_fusion
+{
+
+namespace imu
+{
+
+void Propagator::Reset(double time, const SE3d &pose, const Vector3d &v, const Bias &bias)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    origin_time_ = last_time_ = time;
+    origin_pose_ = pose;
+    origin_v_ = v;
+    bias_ = bias;
+    preintegration_ = Preintegration::Create(bias);
+
+    // replay the samples received while the frame was being tracked
+    bool replayed = false;
+    for (auto &sample : samples_)
+    {
+        if (sample.t > time)
+        {
+            Integrate(sample);
+            replayed = true;
+        }
+    }
+    if (!replayed)
+    {
+        State state;
+        state.time = time;
+        state.pose = pose;
+        state.v = v;
+        state.w = samples_.empty() ? Vector3d::Zero() : Vector3d(samples_.back().w - bias.linearized_bg);
+        Publish(state);
+    }
+}
+
+void Propagator::Propagate(double time, const Vector3d &acc, const Vector3d &gyr)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    samples_.push_back(ImuData(acc, gyr, time));
+    while (samples_.front().t < time - max_time_)
+    {
+        samples_.pop_front();
+    }
+    Integrate(samples_.back());
+}
+
+void Propagator::Integrate(const ImuData &sample)
+{
+    if (!preintegration_)
+        return;
+    double dt = sample.t - last_time_;
+    if (dt <= 0)
+        return;
+    if (sample.t - origin_time_ > max_time_)
+    {
+        // too long without a tracked frame, pure imu propagation is not reliable
+        preintegration_.reset();
+        return;
+    }
+    if (preintegration_->buf.empty())
+    {
+        preintegration_->Append(dt, sample.a, sample.w, sample.a, sample.w);
+    }
+    else
+    {
+        preintegration_->Append(dt, sample.a, sample.w, last_sample_.a, last_sample_.w);
+    }
+    last_sample_ = sample;
+    last_time_ = sample.t;
+
+    // same as Frontend::PredictState
+    Vector3d G(0, 0, -Imu::Get()->G);
+    double sum_dt = preintegration_->sum_dt;
+    Vector3d twb1 = origin_pose_.translation();
+    Matrix3d Rwb1 = origin_pose_.rotationMatrix();
+    Vector3d Vwb1 = origin_v_;
+    Matrix3d Rwb2 = normalize_R(Rwb1 * preintegration_->GetDeltaRotation(bias_).toRotationMatrix());
+    Vector3d twb2 = twb1 + Vwb1 * sum_dt + 0.5f * sum_dt * sum_dt * G + Rwb1 * preintegration_->GetDeltaPosition(bias_);
+    Vector3d Vwb2 = Vwb1 + sum_dt * G + Rwb1 * preintegration_->GetDeltaVelocity(bias_);
+
+    State state;
+    state.time = sample.t;
+    state.pose = SE3d(Quaterniond(Rwb2), twb2);
+    state.v = Vwb2;
+    state.w = sample.w - bias_.linearized_bg;
+    Publish(state);
+}
+
+void Propagator::Publish(const State &state)
+{
+    double values[num_values];
+    values[0] = state.time;
+    std::copy(state.pose.data(), state.pose.data() + 7, values + 1);
+    Eigen::Map<Vector3d>(values + 8) = state.v;
+    Eigen::Map<Vector3d>(values + 11) = state.w;
+
+    // single writer, odd sequence means writing
+    unsigned sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < num_values; i++)
+    {
+        slot_[i].store(values[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+bool Propagator::Get(State &state) const
+{
+    double values[num_values];
+    unsigned begin, end;
+    do
+    {
+        begin = sequence_.load(std::memory_order_acquire);
+        for (int i = 0; i < num_values; i++)
+        {
+            values[i] = slot_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        end = sequence_.load(std::memory_order_relaxed);
+    } while (begin != end || begin & 1);
+
+    if (begin == 0)
+        return false;
+    state.time = values[0];
+    state.pose = Eigen::Map<const SE3d>(values + 1);
+    state.v = Eigen::Map<const Vector3d>(values + 8);
+    state.w = Eigen::Map<const Vector3d>(values + 11);
+    return true;
+}
+
+} // namespace imu
+
+} // namespace lvio_fusion
@@ -118,6 +118,11 @@ bool Relocator::DetectLoop(Frame::Ptr frame, Frame::Ptr &old_frame)
         points_index[2] < points.size() && points_distance[2] < threshold)
     {
         double time = map[points[points_index[0]].intensity];
+        // the candidate may be in an archived region
+        if (archive_ && archive_->Contains(time))
+        {
+            archive_->Load(time);
+        }
         old_frame = Map::Instance().GetKeyFrame(time);
     }
 
@@ -84,7 +84,7 @@ bool InertialOptimization(Frames &frames, Matrix3d &Rwg, double prior_a, double
     {
         Frame::Ptr frame = pair.second;
         frame->SetBias(bias);
-        frame->preintegration->Repropagate(bias.linearized_ba, bias.linearized_bg);
+        frame->preintegration->Relinearize(bias);
     }
     return true;
 }
@@ -172,10 +172,16 @@ void FullBA(Frames &frames, double prior_a, double prior_g)
 
 void RecoverBias(Frames &frames)
 {
+    // without thresholds, the window keeps the first order correction only
+    bool relinearize = Imu::Get()->REPROPAGATE_BA > 0 || Imu::Get()->REPROPAGATE_BG > 0;
     for (auto &pair : frames)
     {
         auto frame = pair.second;
         frame->SetBias(frame->bias);
+        if (relinearize && frame->preintegration)
+        {
+            frame->preintegration->Relinearize(frame->bias);
+        }
     }
 }
 
@@ -0,0 +1,194 @@
+#include "lvio_fusion/ceres/visual_error.hpp"
+#include "lvio_fusion/visual/camera.h"
+
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace lvio_fusion;
+
+const int num_trials = 20;
+std::mt19937 generator(0);
+
+double uniform(double a, double b)
+{
+    return std::uniform_real_distribution<double>(a, b)(generator);
+}
+
+Vector2d random_pixel()
+{
+    return Vector2d(uniform(100, 640), uniform(100, 380));
+}
+
+SE3d random_pose(double angle, double distance)
+{
+    Vector3d axis(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+    Vector3d t(uniform(-distance, distance), uniform(-distance, distance), uniform(-distance, distance));
+    return SE3d(Quaterniond(AngleAxisd(uniform(-angle, angle), axis.normalized())), t);
+}
+
+// stereo pair looking along the x axis of the robot
+Camera::Ptr stereo_camera(int id)
+{
+    if (Camera::Num() == 0)
+    {
+        Matrix3d Rbc;
+        Rbc << 0, 0, 1, -1, 0, 0, 0, -1, 0;
+        SE3d extrinsic(Quaterniond(Rbc), Vector3d(0.1, 0.05, 0.2));
+        Camera::Create(450, 455, 370, 240, extrinsic);
+        Camera::Create(450, 455, 370, 240, extrinsic * SE3d(Quaterniond::Identity(), Vector3d(0.11, 0, 0)));
+    }
+    return Camera::Get(id);
+}
+
+// jacobians of poses are compared in the tangent space of the pose parameterization,
+// the ambient ones differ along the norm of the quaternion
+void evaluate(const ceres::CostFunction &cost, const std::vector<double *> &parameters, VectorXd &residuals, std::vector<MatrixXd> &jacobians)
+{
+    auto &sizes = cost.parameter_block_sizes();
+    std::vector<Matrix<double, Dynamic, Dynamic, RowMajor>> ambient(sizes.size());
+    std::vector<double *> ambient_data;
+    for (int i = 0; i < sizes.size(); i++)
+    {
+        ambient[i].resize(cost.num_residuals(), sizes[i]);
+        ambient_data.push_back(ambient[i].data());
+    }
+    residuals.resize(cost.num_residuals());
+    ASSERT_TRUE(cost.Evaluate(parameters.data(), residuals.data(), ambient_data.data()));
+
+    jacobians.clear();
+    for (int i = 0; i < sizes.size(); i++)
+    {
+        if (sizes[i] == SE3d::num_parameters)
+        {
+            Matrix<double, 4, 3, RowMajor> q_plus;
+            ceres::EigenQuaternionParameterization().ComputeJacobian(parameters[i], q_plus.data());
+            Matrix<double, 7, 6> plus = Matrix<double, 7, 6>::Zero();
+            plus.topLeftCorner<4, 3>() = q_plus;
+            plus.bottomRightCorner<3, 3>() = Matrix3d::Identity();
+            jacobians.push_back(ambient[i] * plus);
+        }
+        else
+        {
+            jacobians.push_back(ambient[i]);
+        }
+    }
+}
+
+void expect_near(const MatrixXd &analytic, const MatrixXd &autodiff)
+{
+    ASSERT_EQ(analytic.rows(), autodiff.rows());
+    ASSERT_EQ(analytic.cols(), autodiff.cols());
+    EXPECT_LT((analytic - autodiff).norm(), 1e-6 * std::max(1.0, autodiff.norm()))
+        << "analytic:\n"
+        << analytic << "\nautodiff:\n"
+        << autodiff;
+}
+
+void compare(const ceres::CostFunction &analytic, const ceres::CostFunction &autodiff, const std::vector<double *> &parameters)
+{
+    VectorXd residuals_analytic, residuals_autodiff;
+    std::vector<MatrixXd> jacobians_analytic, jacobians_autodiff;
+    evaluate(analytic, parameters, residuals_analytic, jacobians_analytic);
+    evaluate(autodiff, parameters, residuals_autodiff, jacobians_autodiff);
+    expect_near(residuals_analytic, residuals_autodiff);
+    for (int i = 0; i < parameters.size(); i++)
+    {
+        expect_near(jacobians_analytic[i], jacobians_autodiff[i]);
+    }
+}
+
+TEST(VisualError, PoseOnly)
+{
+    for (int i = 0; i < num_trials; i++)
+    {
+        SE3d pose = random_pose(M_PI, 10);
+        Vector3d pw = pose * stereo_camera(0)->extrinsic * Vector3d(uniform(-2, 2), uniform(-2, 2), uniform(3, 20));
+        Vector2d ob = random_pixel();
+        double weight = uniform(1, 50);
+        PoseOnlyReprojectionCost analytic(ob, pw, stereo_camera(0), weight);
+        ceres::AutoDiffCostFunction<PoseOnlyReprojectionError, 2, 7> autodiff(
+            new PoseOnlyReprojectionError(ob, pw, stereo_camera(0), weight));
+        compare(analytic, autodiff, {pose.data()});
+    }
+}
+
+TEST(VisualError, TwoFrame)
+{
+    for (int i = 0; i < num_trials; i++)
+    {
+        SE3d pose1 = random_pose(M_PI, 10), pose2 = pose1 * random_pose(0.2, 0.5);
+        Vector2d first_ob = random_pixel(), ob = random_pixel();
+        double inv_d = 1 / uniform(3, 20), weight = uniform(1, 50);
+        TwoFrameReprojectionCost analytic(first_ob, ob, stereo_camera(0), stereo_camera(1), weight);
+        ceres::AutoDiffCostFunction<TwoFrameReprojectionError, 2, 1, 7, 7> autodiff(
+            new TwoFrameReprojectionError(first_ob, ob, stereo_camera(0), stereo_camera(1), weight));
+        compare(analytic, autodiff, {&inv_d, pose1.data(), pose2.data()});
+    }
+}
+
+TEST(VisualError, TwoCamera)
+{
+    for (int i = 0; i < num_trials; i++)
+    {
+        Vector2d left_ob = random_pixel(), right_ob = random_pixel();
+        double inv_d = 1 / uniform(3, 20), weight = uniform(1, 50);
+        TwoCameraReprojectionCost analytic(left_ob, right_ob, stereo_camera(0), stereo_camera(1), weight);
+        ceres::AutoDiffCostFunction<TwoCameraReprojectionError, 2, 1> autodiff(
+            new TwoCameraReprojectionError(left_ob, right_ob, stereo_camera(0), stereo_camera(1), weight));
+        compare(analytic, autodiff, {&inv_d});
+    }
+}
+
+// every observation of the multi-frame cost is a two-frame cost
+TEST(VisualError, MultiFrame)
+{
+    const int n = 3;
+    for (int i = 0; i < num_trials; i++)
+    {
+        SE3d host = random_pose(M_PI, 10);
+        Matrix<double, 7, n> targets;
+        Matrix2Xd obs(2, n);
+        VectorXd weights(n);
+        for (int j = 0; j < n; j++)
+        {
+            SE3d target = host * random_pose(0.2, 0.5);
+            targets.col(j) = Eigen::Map<const Matrix<double, 7, 1>>(target.data());
+            obs.col(j) = random_pixel();
+            weights[j] = uniform(1, 50);
+        }
+        Vector2d first_ob = random_pixel();
+        double inv_d = 1 / uniform(3, 20);
+
+        MultiFrameReprojectionCost analytic(first_ob, obs, weights, stereo_camera(0), stereo_camera(1));
+        std::vector<double *> parameters = {&inv_d, host.data()};
+        for (int j = 0; j < n; j++)
+        {
+            parameters.push_back(targets.col(j).data());
+        }
+        VectorXd residuals;
+        std::vector<MatrixXd> jacobians;
+        evaluate(analytic, parameters, residuals, jacobians);
+
+        for (int j = 0; j < n; j++)
+        {
+            ceres::AutoDiffCostFunction<TwoFrameReprojectionError, 2, 1, 7, 7> autodiff(
+                new TwoFrameReprojectionError(first_ob, obs.col(j), stereo_camera(0), stereo_camera(1), weights[j]));
+            VectorXd residual;
+            std::vector<MatrixXd> jacobians_autodiff;
+            evaluate(autodiff, {&inv_d, host.data(), targets.col(j).data()}, residual, jacobians_autodiff);
+            expect_near(residuals.segment<2>(2 * j), residual);
+            expect_near(jacobians[0].middleRows(2 * j, 2), jacobians_autodiff[0]);
+            expect_near(jacobians[1].middleRows(2 * j, 2), jacobians_autodiff[1]);
+            for (int k = 0; k < n; k++)
+            {
+                expect_near(jacobians[k + 2].middleRows(2 * j, 2), k == j ? jacobians_autodiff[2] : MatrixXd(MatrixXd::Zero(2, 6)));
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -120,10 +120,15 @@ void publish_tf(Estimator::Ptr estimator, double time)
     tf::Transform transform;
     tf::Quaternion tf_q;
     tf::Vector3 tf_t;
-    // base_link
+    // base_link, at imu rate if available
     if (estimator->frontend->status == FrontendStatus::TRACKING)
     {
         SE3d pose = estimator->frontend->current_frame->pose;
+        imu::State state;
+        if (estimator->GetLatestState(state) && state.time >= estimator->frontend->current_frame->time)
+        {
+            pose = state.pose;
+        }
         Quaterniond pose_q = pose.unit_quaternion();
         Vector3d pose_t = pose.translation();
         tf_q.setValue(pose_q.w(), pose_q.x(), pose_q.y(), pose_q.z());